@@ -0,0 +1,108 @@
+#ifndef _GPU_DEVICE_ARRAY_H
+#define _GPU_DEVICE_ARRAY_H
+
+#include <CL/cl.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// ------------------------------------------------------------------------------------
+// Context, in-order queue (with profiling) and built programs of one device.
+// Algorithms called with the same session share them, so programs are built once
+// and device arrays stay resident between the calls.
+class Session {
+public:
+    Session(std::pair<cl_platform_id, cl_device_id>& dev_pair);
+    ~Session();
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    // The program is built on the first request and cached by (file, build options)
+    cl_program getProgram(const char* file, const std::string& build_options = "");
+
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+
+private:
+    std::map<std::string, cl_program> programs;
+};
+
+// ------------------------------------------------------------------------------------
+// Array mirrored on the host and on the device of a session. Dirty flags track which
+// side holds the valid copy, so data crosses the bus only when the other side needs it.
+template <typename T>
+class DeviceArray {
+public:
+    // Wraps user host memory: it has to outlive the array
+    DeviceArray(Session& _session, T* _host_ptr, const size_t _count)
+        : session(_session), host_ptr(_host_ptr), count(_count), host_valid(true), device_valid(false) {
+        cl_int error = CL_SUCCESS;
+        buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(T) * count, nullptr, &error);
+        CONTROL("clCreateBuffer DeviceArray", error);
+    }
+    // Intermediate array: host memory is allocated by the array itself
+    DeviceArray(Session& _session, const size_t _count)
+        : DeviceArray(_session, nullptr, _count) {
+        storage.resize(count);
+        host_ptr = storage.data();
+    }
+    ~DeviceArray() {
+        clReleaseMemObject(buffer);
+    }
+    DeviceArray(const DeviceArray&) = delete;
+    DeviceArray& operator=(const DeviceArray&) = delete;
+
+    // Device copy which a kernel is going to read: uploaded if the host copy is newer
+    cl_mem& read() {
+        if (!device_valid) {
+            CONTROL("clEnqueueWriteBuffer DeviceArray",
+                clEnqueueWriteBuffer(session.queue, buffer, CL_TRUE, 0, sizeof(T) * count, host_ptr, 0, nullptr, nullptr));
+            device_valid = true;
+        }
+        return buffer;
+    }
+    // Device copy which a kernel is going to overwrite completely: nothing is uploaded
+    cl_mem& write() {
+        device_valid = true;
+        host_valid = false;
+        return buffer;
+    }
+    // Device copy which a kernel is going to update partially
+    cl_mem& readWrite() {
+        read();
+        host_valid = false;
+        return buffer;
+    }
+    // Host copy: downloaded if the device copy is newer
+    T* host() {
+        if (!host_valid) {
+            CONTROL("clEnqueueReadBuffer DeviceArray",
+                clEnqueueReadBuffer(session.queue, buffer, CL_TRUE, 0, sizeof(T) * count, host_ptr, 0, nullptr, nullptr));
+            host_valid = true;
+        }
+        return host_ptr;
+    }
+    // Has to be called after the data obtained by host() was changed
+    void hostModified() {
+        host_valid = true;
+        device_valid = false;
+    }
+
+    size_t size() const { return count; }
+    Session& getSession() { return session; }
+
+private:
+    Session& session;
+    T* host_ptr;
+    std::vector<T> storage;
+    size_t count;
+    cl_mem buffer;
+    bool host_valid;
+    bool device_valid;
+};
+
+#endif //_GPU_DEVICE_ARRAY_H
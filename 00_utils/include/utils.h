@@ -6,6 +6,8 @@
 #include <random>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <limits>
 #include <chrono>
 
 #include "exceptions.h"
@@ -25,10 +27,37 @@ using ms = std::chrono::milliseconds;
 using s = std::chrono::seconds;
 using timer = std::pair<std::chrono::high_resolution_clock::time_point, std::chrono::high_resolution_clock::time_point>;
 
+// A kernel file compiled into the executable by 00_utils/tools/embed_kernels.py. The same file
+// may be listed several times, once per SPIR-V variant precompiled with il_options.
+struct EmbeddedKernel {
+    const char* file;
+    const char* source;
+    size_t source_size;
+    const unsigned char* il;
+    size_t il_size;
+    const char* il_options;
+};
+
+bool registerEmbeddedKernels(const EmbeddedKernel* kernels, size_t count);
+
+// Embedded sources are used first, the others are read from disk once per process
 cl_program createProgramFromSource(cl_context ctx, const char* file);
+// Prefers the precompiled SPIR-V built with exactly these options if the device accepts IL
+cl_program createProgram(cl_context ctx, cl_device_id device, const char* file, const std::string& build_options = "");
 cl_uint getCountAndListOfPlatforms(std::vector<cl_platform_id>& pl);
 cl_device_id getDevice(cl_device_type type, cl_platform_id& plfrm_id);
 
+// Device fission: the sub-devices are released with clReleaseDevice. An affinity domain is
+// CL_DEVICE_AFFINITY_DOMAIN_NUMA, CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE, etc.
+std::vector<cl_device_id> createSubDevicesEqually(cl_device_id device, const cl_uint units);
+std::vector<cl_device_id> createSubDevicesByCounts(cl_device_id device, const std::vector<cl_uint>& counts);
+std::vector<cl_device_id> createSubDevicesByAffinity(cl_device_id device, const cl_device_affinity_domain domain);
+// A partition type of CL_DEVICE_PARTITION_PROPERTIES: CL_DEVICE_PARTITION_EQUALLY, CL_DEVICE_PARTITION_BY_COUNTS, etc.
+bool supportsPartition(cl_device_id device, const cl_device_partition_property partition);
+// A sub-device with all compute units of the device but `reserved` ones, they are left to the host threads.
+// The device itself if it can't be partitioned by counts
+cl_device_id reserveHostCores(cl_device_id device, const cl_uint reserved);
+
 size_t getTheClosestBiggerDegreeOf2(const size_t x);
 
 
@@ -57,10 +86,9 @@ void generateSymmetricPositiveMatrix(T* matrix, int size) {
     static std::uniform_real_distribution<T> dist_diag{ size * 3.f, size * 3.f + 1.f };
 
     for (size_t i = 0; i < size; ++i) {
-        for (size_t j = 0; j < size; ++j) {
-            float tmp = dist(rd);
-            if (i != j)
-                matrix[i * size + j] = tmp;
+        for (size_t j = 0; j < i; ++j) {
+            matrix[i * size + j] = dist(rd);
+            matrix[j * size + i] = matrix[i * size + j];
         }
         matrix[i * size + i] = dist_diag(rd);
     }
@@ -80,20 +108,14 @@ bool checkCorrect(T* actual, T* reference, int size) {
     return true;
 }
 
+// Compares A * x (`actual`, computed by the caller in double) with b and reports the max relative residual
 template <typename T>
-void checkSolutionOfSOLE(const size_t size, const T* A, const T* b, const T* x, const float eps) {
+void checkResidualOfSOLE(const std::vector<double>& actual, const T* b, const double eps) {
     std::cout << std::fixed;
-    std::cout.precision(6);
-
-    std::vector<T> actual(size, 0);
-    for (size_t i = 0; i < size; i++) {
-        for (size_t j = 0; j < size; j++) {
-            actual[i] += A[j * size + i] * x[j];
-        }
-    }
+    std::cout.precision(eps < 1e-6 ? 15 : 6);
 
-    float accuracy = std::numeric_limits<float>::min();
-    for (size_t i = 0; i < size; ++i) {
+    double accuracy = std::numeric_limits<float>::min();
+    for (size_t i = 0; i < actual.size(); ++i) {
         if (fabs((actual[i] - b[i]) / b[i]) > accuracy)
             accuracy = fabs((actual[i] - b[i]) / b[i]);
     }
@@ -102,6 +124,18 @@ void checkSolutionOfSOLE(const size_t size, const T* A, const T* b, const T* x,
     std::cout << "-- Check-status: " << result << std::endl;
 }
 
+// The residual is accumulated in double, so the check also holds for the solutions refined in double
+template <typename TA, typename T>
+void checkSolutionOfSOLE(const size_t size, const TA* A, const T* b, const T* x, const double eps) {
+    std::vector<double> actual(size, 0);
+    for (size_t i = 0; i < size; i++) {
+        for (size_t j = 0; j < size; j++) {
+            actual[i] += static_cast<double>(A[j * size + i]) * x[j];
+        }
+    }
+    checkResidualOfSOLE(actual, b, eps);
+}
+
 // ------------------------------------------------------------------------------------
 // Print the system: matrices and vectors.
 template <typename T>
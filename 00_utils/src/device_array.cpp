@@ -0,0 +1,36 @@
+#include "../include/device_array.h"
+
+
+Session::Session(std::pair<cl_platform_id, cl_device_id>& dev_pair) : platform(dev_pair.first), device(dev_pair.second) {
+    cl_int error = CL_SUCCESS;
+    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+
+    context = clCreateContext((nullptr == platform) ? nullptr : properties, 1, &device, nullptr, nullptr, &error);
+    CONTROL("clCreateContext", error);
+
+    cl_queue_properties props[3] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+    queue = clCreateCommandQueueWithProperties(context, device, props, &error);
+    // The destructor doesn't run if the constructor throws
+    if (error != CL_SUCCESS)
+        clReleaseContext(context);
+    CONTROL("clCreateCommandQueue", error);
+}
+
+Session::~Session() {
+    for (auto& program : programs)
+        clReleaseProgram(program.second);
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+}
+
+cl_program Session::getProgram(const char* file, const std::string& build_options) {
+    const std::string key = std::string(file) + "|" + build_options;
+    auto it = programs.find(key);
+    if (it != programs.end())
+        return it->second;
+
+    cl_program program = createProgram(context, device, file, build_options);
+    CONTROL("clBuildProgram", clBuildProgram(program, 1, &device, build_options.c_str(), nullptr, nullptr));
+    programs[key] = program;
+    return program;
+}
@@ -1,12 +1,94 @@
 #include "../include/utils.h"
 
+#include <algorithm>
+#include <map>
+#include <mutex>
 
-cl_program createProgramFromSource(cl_context ctx, const char* file) {
+
+typedef cl_program (CL_API_CALL* CreateProgramWithIL)(cl_context, const void*, size_t, cl_int*);
+
+// Filled by the static initializers of the generated embedded_kernels.cpp before main
+static std::multimap<std::string, const EmbeddedKernel*>& embeddedKernels() {
+    static std::multimap<std::string, const EmbeddedKernel*> kernels;
+    return kernels;
+}
+
+bool registerEmbeddedKernels(const EmbeddedKernel* kernels, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        embeddedKernels().emplace(kernels[i].file, &kernels[i]);
+    return true;
+}
+
+// `#include "name"` lines are replaced by the file next to the including one, as embed_kernels.py does,
+// so the sources don't depend on the -I options of the runtime compiler
+static std::string readKernelSource(const std::string& file) {
     std::fstream kernel_file(file, std::ios::in);
-    std::string kernel_code((std::istreambuf_iterator<char>(kernel_file)), std::istreambuf_iterator<char>());
-    kernel_file.close();
-    const char* kernel_code_p = kernel_code.c_str();
-    size_t kernel_code_len = kernel_code.size();
+    if (!kernel_file.is_open()) {
+        THROW_EXCEPTION(file, std::string("The kernel is neither embedded nor found on disk"));
+    }
+    const std::string dir = file.substr(0, file.find_last_of("/\\") + 1);
+    const std::string directive = "#include \"";
+    std::string kernel_code, line;
+    while (std::getline(kernel_file, line)) {
+        const size_t begin = line.find_first_not_of(" \t");
+        const size_t end = line.rfind('"');
+        if (begin != std::string::npos && line.compare(begin, directive.size(), directive) == 0 && end > begin + directive.size())
+            kernel_code += readKernelSource(dir + line.substr(begin + directive.size(), end - begin - directive.size()));
+        else
+            kernel_code += line + "\n";
+    }
+    return kernel_code;
+}
+
+static const std::string& kernelSourceFromFile(const char* file) {
+    static std::mutex mutex;
+    static std::map<std::string, std::string> sources;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sources.find(file);
+    if (it == sources.end())
+        it = sources.emplace(file, readKernelSource(file)).first;
+    return it->second;
+}
+
+// Returns nullptr if the device can't consume SPIR-V
+static CreateProgramWithIL programWithILEntry(cl_device_id device) {
+    size_t size = 0;
+    std::string info;
+    if (clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, nullptr, &size) == CL_SUCCESS && size > 0) {
+        info.resize(size);
+        CONTROL("clGetDeviceInfo", clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, size, &info[0], nullptr));
+        if (info.find("cl_khr_il_program") != std::string::npos) {
+            cl_platform_id platform = nullptr;
+            CONTROL("clGetDeviceInfo",
+                clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, nullptr));
+            return reinterpret_cast<CreateProgramWithIL>(
+                clGetExtensionFunctionAddressForPlatform(platform, "clCreateProgramWithILKHR"));
+        }
+    }
+#ifdef CL_VERSION_2_1
+    // Core since OpenCL 2.1, older devices reject the query
+    if (clGetDeviceInfo(device, CL_DEVICE_IL_VERSION, 0, nullptr, &size) == CL_SUCCESS && size > 0) {
+        info.resize(size);
+        CONTROL("clGetDeviceInfo", clGetDeviceInfo(device, CL_DEVICE_IL_VERSION, size, &info[0], nullptr));
+        if (info.find("SPIR-V") != std::string::npos)
+            return clCreateProgramWithIL;
+    }
+#endif
+    return nullptr;
+}
+
+cl_program createProgramFromSource(cl_context ctx, const char* file) {
+    const char* kernel_code_p = nullptr;
+    size_t kernel_code_len = 0;
+    auto embedded = embeddedKernels().find(file);
+    if (embedded != embeddedKernels().end()) {
+        kernel_code_p = embedded->second->source;
+        kernel_code_len = embedded->second->source_size;
+    } else {
+        const std::string& kernel_code = kernelSourceFromFile(file);
+        kernel_code_p = kernel_code.c_str();
+        kernel_code_len = kernel_code.size();
+    }
 
     cl_int errorcode = CL_SUCCESS;
     cl_program program = clCreateProgramWithSource(ctx, 1, &kernel_code_p, &kernel_code_len, &errorcode);
@@ -15,6 +97,33 @@ cl_program createProgramFromSource(cl_context ctx, const char* file) {
     return program;
 }
 
+cl_program createProgram(cl_context ctx, cl_device_id device, const char* file, const std::string& build_options) {
+    // The -D options are baked into the IL, so only a variant built with the same options is usable
+    auto variants = embeddedKernels().equal_range(file);
+    bool has_il = false;
+    for (auto it = variants.first; it != variants.second; ++it) {
+        const EmbeddedKernel* kernel = it->second;
+        has_il = has_il || kernel->il != nullptr;
+        if (kernel->il == nullptr || build_options != kernel->il_options)
+            continue;
+
+        CreateProgramWithIL create_program = programWithILEntry(device);
+        if (create_program == nullptr)
+            break;
+
+        cl_int errorcode = CL_SUCCESS;
+        cl_program program = create_program(ctx, kernel->il, kernel->il_size, &errorcode);
+        CONTROL("clCreateProgramWithIL", errorcode);
+        return program;
+    }
+
+    if (has_il && programWithILEntry(device) != nullptr) {
+        std::cout << "[ INFO ] No SPIR-V of " << file << " is built with \"" << build_options
+            << "\", the source is compiled" << std::endl;
+    }
+    return createProgramFromSource(ctx, file);
+}
+
 cl_uint getCountAndListOfPlatforms(std::vector<cl_platform_id>& pl) {
     std::cout << "*===================================*" << std::endl
         << "\tPLATFORMS INFO" << std::endl
@@ -85,6 +194,53 @@ cl_device_id getDevice(cl_device_type type, cl_platform_id& plfrm_id) {
     return nullptr;
 }
 
+static std::vector<cl_device_id> createSubDevices(cl_device_id device, const cl_device_partition_property* properties) {
+    cl_uint count = 0;
+    CONTROL("clCreateSubDevices", clCreateSubDevices(device, properties, 0, nullptr, &count));
+    std::vector<cl_device_id> sub_devices(count);
+    CONTROL("clCreateSubDevices", clCreateSubDevices(device, properties, count, sub_devices.data(), nullptr));
+    return sub_devices;
+}
+
+bool supportsPartition(cl_device_id device, const cl_device_partition_property partition) {
+    size_t size = 0;
+    CONTROL("clGetDeviceInfo", clGetDeviceInfo(device, CL_DEVICE_PARTITION_PROPERTIES, 0, nullptr, &size));
+    std::vector<cl_device_partition_property> partitions(size / sizeof(cl_device_partition_property));
+    CONTROL("clGetDeviceInfo", clGetDeviceInfo(device, CL_DEVICE_PARTITION_PROPERTIES, size, partitions.data(), nullptr));
+    return std::find(partitions.begin(), partitions.end(), partition) != partitions.end();
+}
+
+std::vector<cl_device_id> createSubDevicesEqually(cl_device_id device, const cl_uint units) {
+    const cl_device_partition_property properties[3] = { CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)units, 0 };
+    return createSubDevices(device, properties);
+}
+
+std::vector<cl_device_id> createSubDevicesByCounts(cl_device_id device, const std::vector<cl_uint>& counts) {
+    std::vector<cl_device_partition_property> properties = { CL_DEVICE_PARTITION_BY_COUNTS };
+    for (auto count : counts)
+        properties.push_back((cl_device_partition_property)count);
+    properties.push_back(CL_DEVICE_PARTITION_BY_COUNTS_LIST_END);
+    properties.push_back(0);
+    return createSubDevices(device, properties.data());
+}
+
+std::vector<cl_device_id> createSubDevicesByAffinity(cl_device_id device, const cl_device_affinity_domain domain) {
+    const cl_device_partition_property properties[3] = { CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, (cl_device_partition_property)domain, 0 };
+    return createSubDevices(device, properties);
+}
+
+cl_device_id reserveHostCores(cl_device_id device, const cl_uint reserved) {
+    cl_uint units = 0;
+    CONTROL("clGetDeviceInfo", clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &units, nullptr));
+    if (reserved >= units) {
+        THROW_EXCEPTION(std::string("reserveHostCores"), std::to_string(reserved) + " of " + std::to_string(units) + " compute units")
+    }
+    // Some CPU runtimes only split equally or by affinity domains
+    if (!supportsPartition(device, CL_DEVICE_PARTITION_BY_COUNTS))
+        return device;
+    return createSubDevicesByCounts(device, { units - reserved }).front();
+}
+
 size_t getTheClosestBiggerDegreeOf2(const size_t x) {
     size_t degree = 1;
     while (true) {
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Embeds the OpenCL kernels of a lab into a C++ source file.
+
+usage: embed_kernels.py KERNELS_DIR OUTPUT.cpp [--spirv] [--il FILE.cl=OPTIONS ...] [--header FILE.h ...]
+
+Every KERNELS_DIR/*.cl is registered under "kernels/<name>", the path the labs pass to
+createProgramFromSource/Session::getProgram, so the executables don't depend on the working
+directory. With --spirv each --il variant is also compiled offline to SPIR-V with clang and
+llvm-spirv; it's loaded at runtime only when the program is built with exactly OPTIONS.
+{NAME} in OPTIONS is replaced by the value of `#define NAME value` in the --header files, so the
+variants follow the constants the labs build their options from.
+"""
+
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+def c_array(name, data, type_name):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "static const %s %s[] = {\n%s\n};\n" % (type_name, name, "\n".join(lines))
+
+
+def c_string(value):
+    return '"' + value.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+DEFINE = re.compile(r'^[ \t]*#define[ \t]+(\w+)[ \t]+([^/\r\n]+?)[ \t]*(?://.*)?$', re.M)
+INCLUDE = re.compile(rb'^[ \t]*#include "([^"]+)"', re.M)
+
+
+def read_source(path):
+    """The source with every #include "name" replaced by the file next to the including one."""
+    with open(path, "rb") as f:
+        source = f.read()
+    return INCLUDE.sub(lambda m: read_source(os.path.join(os.path.dirname(path), m.group(1).decode())).rstrip(b"\n"),
+                       source)
+
+
+def header_defines(headers):
+    defines = {}
+    for header in headers:
+        with open(header, "r") as f:
+            defines.update(DEFINE.findall(f.read()))
+    return defines
+
+
+def expand_options(options, defines):
+    def value(m):
+        if m.group(1) not in defines:
+            sys.exit("embed_kernels: %s isn't defined in the --header files" % m.group(1))
+        return defines[m.group(1)]
+    return re.sub(r"\{(\w+)\}", value, options)
+
+
+def compile_spirv(args, path, options):
+    with tempfile.TemporaryDirectory() as tmp:
+        bc = os.path.join(tmp, "kernel.bc")
+        spv = os.path.join(tmp, "kernel.spv")
+        subprocess.check_call([args.clang, "-c", "-x", "cl", "-cl-std=" + args.cl_std, "-target", args.target,
+                               "-emit-llvm", "-Xclang", "-finclude-default-header", "-O2"]
+                              + options.split() + ["-o", bc, path])
+        subprocess.check_call([args.llvm_spirv, bc, "-o", spv])
+        with open(spv, "rb") as f:
+            return f.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Embed OpenCL kernels into a C++ source file")
+    parser.add_argument("kernels_dir")
+    parser.add_argument("output")
+    parser.add_argument("--spirv", action="store_true", help="precompile the --il variants to SPIR-V")
+    parser.add_argument("--il", action="append", default=[], metavar="FILE.cl=OPTIONS",
+                        help="build options of a SPIR-V variant, may be repeated per file")
+    parser.add_argument("--header", action="append", default=[], help="header with the #defines used in OPTIONS")
+    parser.add_argument("--clang", default="clang")
+    parser.add_argument("--llvm-spirv", default="llvm-spirv")
+    parser.add_argument("--target", default="spir64")
+    parser.add_argument("--cl-std", default="CL1.2")
+    args = parser.parse_args()
+
+    defines = header_defines(args.header)
+    variants = {}
+    for il in args.il:
+        name, _, options = il.partition("=")
+        variants.setdefault(name, []).append(expand_options(options, defines))
+
+    files = sorted(glob.glob(os.path.join(args.kernels_dir, "*.cl")))
+    unknown = set(variants) - set(os.path.basename(f) for f in files)
+    if unknown:
+        sys.exit("embed_kernels: no such kernels: " + ", ".join(sorted(unknown)))
+
+    out = ["// Generated by 00_utils/tools/embed_kernels.py, do not edit\n",
+           '#include "utils.h"\n\n']
+    entries = []
+    for i, path in enumerate(files):
+        name = os.path.basename(path)
+        source = read_source(path)
+        out.append(c_array("source_%d" % i, source + b"\0", "unsigned char"))
+        file_key = c_string("kernels/" + name)
+        source_ref = "reinterpret_cast<const char*>(source_%d), sizeof(source_%d) - 1" % (i, i)
+        if not args.spirv or name not in variants:
+            entries.append("{ %s, %s, nullptr, 0, nullptr }" % (file_key, source_ref))
+            continue
+        for j, options in enumerate(variants[name]):
+            il_name = "il_%d_%d" % (i, j)
+            out.append(c_array(il_name, compile_spirv(args, path, options), "unsigned char"))
+            entries.append("{ %s, %s, %s, sizeof(%s), %s }" % (file_key, source_ref, il_name, il_name,
+                                                             c_string(options)))
+
+    if entries:
+        out.append("\nstatic const EmbeddedKernel embedded_kernels[] = {\n")
+        out.extend("    %s,\n" % e for e in entries)
+        out.append("};\n\nstatic const bool embedded_kernels_registered =\n"
+                   "    registerEmbeddedKernels(embedded_kernels, sizeof(embedded_kernels) / sizeof(EmbeddedKernel));\n")
+    text = "".join(out)
+
+    # Rewriting an unchanged file would rebuild and relink the lab every time
+    if os.path.exists(args.output):
+        with open(args.output, "r", newline="") as f:
+            if f.read() == text:
+                return
+    os.makedirs(os.path.dirname(os.path.abspath(args.output)), exist_ok=True)
+    with open(args.output, "w", newline="\n") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
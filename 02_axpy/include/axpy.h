@@ -3,6 +3,7 @@
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #define THREADS 6
+#define AXPY_PROBE (1 << 20) // elements of the bandwidth probe of the hetero AXPY
 
 #include <omp.h>
 #include <vector>
@@ -10,6 +11,7 @@
 #include <chrono>
 
 #include "utils.h"
+#include "device_array.h"
 
 void saxpy(const int& n, const float a, const float* x, const int& incx, float* y, const int& incy);
 void daxpy(const int& n, const double a, const double* x, const int& incx, double* y, const int& incy);
@@ -20,4 +22,19 @@ void daxpy_omp(const int& n, const double a, const double* x, const int& incx, d
 void saxpy_cl(int n, float a, const float* x, int incx, float* y, int incy, std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time);
 void daxpy_cl(int n, double a, const double* x, int incx, double* y, int incy, std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time);
 
+void saxpy_cl(int n, float a, DeviceArray<float>& x, int incx, DeviceArray<float>& y, int incy, Session& session, timer& time);
+void daxpy_cl(int n, double a, DeviceArray<double>& x, int incx, DeviceArray<double>& y, int incy, Session& session, timer& time);
+
+// Host OMP threads, the CPU device and every GPU update their chunks of y at the same time,
+// the chunks are proportional to the bandwidth of each path (transfers included) measured by a probe.
+// The paths are probed one by one, so the DRAM bandwidth the host threads and the CPU device share
+// isn't accounted for: together they get less than the sum of their probes.
+// The chunk of path p (host, CPU, GPU 0, GPU 1, ...) is [bounds[p], bounds[p + 1])
+void saxpy_hetero(int n, float a, const float* x, int incx, float* y, int incy,
+	std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::vector<std::pair<cl_platform_id, cl_device_id>>& gpu_dev_pairs,
+	timer& time, std::vector<int>& bounds);
+void daxpy_hetero(int n, double a, const double* x, int incx, double* y, int incy,
+	std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::vector<std::pair<cl_platform_id, cl_device_id>>& gpu_dev_pairs,
+	timer& time, std::vector<int>& bounds);
+
 #endif  // _LAB02_AXPY_
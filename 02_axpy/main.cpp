@@ -89,6 +89,20 @@ int main(int argc, char** argv) {
             std::cout << "Time 'CPU' (device " << name << "): " << TIME_MS(time.first, time.second) << std::endl;
             CHECK(FLAG_CHECK, float, ref, y, y_size)
         }
+
+        // HETERO: host threads, the CPU device and all GPUs together
+        if (!gpus.empty() && !cpus.empty()) {
+            fillData<float>(y, y_size);
+            timer time;
+            std::vector<int> bounds;
+            saxpy_hetero(n, a, x, inc_x, y, inc_y, cpus[0], gpus, time, bounds);
+            std::cout << "Time 'HETERO': " << TIME_MS(time.first, time.second) << std::endl;
+            std::cout << "-- elements: host " << bounds[1] << ", CPU " << bounds[2] - bounds[1];
+            for (size_t gpu = 0; gpu < gpus.size(); gpu++)
+                std::cout << ", GPU " << gpu << " " << bounds[gpu + 3] - bounds[gpu + 2];
+            std::cout << std::endl;
+            CHECK(FLAG_CHECK, float, ref, y, y_size)
+        }
         delete[] x;
         delete[] y;
         delete[] ref;
@@ -147,6 +161,20 @@ int main(int argc, char** argv) {
             std::cout << "Time 'CPU' (device " << name << "): " << TIME_MS(time.first, time.second) << std::endl;
             CHECK(FLAG_CHECK, double, ref, y, y_size)
         }
+
+        // HETERO: host threads, the CPU device and all GPUs together
+        if (!gpus.empty() && !cpus.empty()) {
+            fillData<double>(y, y_size);
+            timer time;
+            std::vector<int> bounds;
+            daxpy_hetero(n, a, x, inc_x, y, inc_y, cpus[0], gpus, time, bounds);
+            std::cout << "Time 'HETERO': " << TIME_MS(time.first, time.second) << std::endl;
+            std::cout << "-- elements: host " << bounds[1] << ", CPU " << bounds[2] - bounds[1];
+            for (size_t gpu = 0; gpu < gpus.size(); gpu++)
+                std::cout << ", GPU " << gpu << " " << bounds[gpu + 3] - bounds[gpu + 2];
+            std::cout << std::endl;
+            CHECK(FLAG_CHECK, double, ref, y, y_size)
+        }
         delete[] x;
         delete[] y;
         delete[] ref;
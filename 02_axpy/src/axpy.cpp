@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <thread>
 #include "../include/axpy.h"
 
 
@@ -23,87 +27,157 @@ void daxpy_omp(const int& n, const double a, const double* x, const int& incx, d
 }
 
 void saxpy_cl(int n, float a, const float* x, int incx, float* y, int incy, std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time) {
-    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)dev_pair.first, 0 };
+    Session session(dev_pair);
+    DeviceArray<float> x_array(session, const_cast<float*>(x), incx * n);
+    DeviceArray<float> y_array(session, y, incy * n);
 
-    cl_context context = clCreateContext(properties, 1, &dev_pair.second, NULL, NULL, NULL);
+    saxpy_cl(n, a, x_array, incx, y_array, incy, session, time);
+    y_array.host();
+}
 
-    cl_command_queue queue = clCreateCommandQueue(context, dev_pair.second, 0, NULL);
+void daxpy_cl(int n, double a, const double* x, int incx, double* y, int incy, std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time) {
+    Session session(dev_pair);
+    DeviceArray<double> x_array(session, const_cast<double*>(x), incx * n);
+    DeviceArray<double> y_array(session, y, incy * n);
 
-    cl_program program = createProgramFromSource(context, "kernels/saxpy_kernel.cl");
-    CONTROL("clBuildProgram", clBuildProgram(program, 1, &dev_pair.second, nullptr, nullptr, nullptr));
+    daxpy_cl(n, a, x_array, incx, y_array, incy, session, time);
+    y_array.host();
+}
 
+void saxpy_cl(int n, float a, DeviceArray<float>& x, int incx, DeviceArray<float>& y, int incy, Session& session, timer& time) {
+    cl_program program = session.getProgram("kernels/saxpy_kernel.cl");
     cl_kernel kernel = clCreateKernel(program, "saxpy", NULL);
 
-    cl_mem y_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * incy * n, NULL, NULL);
-    cl_mem x_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * incx * n, NULL, NULL);
-
-    CONTROL("clEnqueueWriteBuffer Y", clEnqueueWriteBuffer(queue, y_buffer, CL_TRUE, 0, sizeof(float) * incy * n, y, 0, NULL, NULL));
-    CONTROL("clEnqueueWriteBuffer X", clEnqueueWriteBuffer(queue, x_buffer, CL_TRUE, 0, sizeof(float) * incx * n, x, 0, NULL, NULL));
-
     CONTROL("clSetKernelArg N", clSetKernelArg(kernel, 0, sizeof(int), &n));
     CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 1, sizeof(float), &a));
-    CONTROL("clSetKernelArg X", clSetKernelArg(kernel, 2, sizeof(cl_mem), &x_buffer));
+    CONTROL("clSetKernelArg X", clSetKernelArg(kernel, 2, sizeof(cl_mem), &x.read()));
     CONTROL("clSetKernelArg INCX", clSetKernelArg(kernel, 3, sizeof(int), &incx));
-    CONTROL("clSetKernelArg Y", clSetKernelArg(kernel, 4, sizeof(cl_mem), &y_buffer));
+    CONTROL("clSetKernelArg Y", clSetKernelArg(kernel, 4, sizeof(cl_mem), &y.readWrite()));
     CONTROL("clSetKernelArg INCY", clSetKernelArg(kernel, 5, sizeof(int), &incy));
 
     size_t group = 256;
     size_t size = (n % group == 0) ? n : n + group - n % group;
 
     time.first = std::chrono::high_resolution_clock::now();
-    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &size, &group, 0, NULL, NULL));
-    CONTROL("clFinisl", clFinish(queue));
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 1, NULL, &size, &group, 0, NULL, NULL));
+    CONTROL("clFinisl", clFinish(session.queue));
     time.second = std::chrono::high_resolution_clock::now();
 
-    clEnqueueReadBuffer(queue, y_buffer, CL_TRUE, 0, sizeof(float) * incy * n, y, 0, NULL, NULL);
-
-    clReleaseMemObject(y_buffer);
-    clReleaseMemObject(x_buffer);
-    clReleaseProgram(program);
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
 }
 
-void daxpy_cl(int n, double a, const double* x, int incx, double* y, int incy, std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time) {
-    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)dev_pair.first, 0 };
-
-    cl_context context = clCreateContext(properties, 1, &dev_pair.second, NULL, NULL, NULL);
-
-    cl_command_queue queue = clCreateCommandQueue(context, dev_pair.second, 0, NULL);
-
-    cl_program program = createProgramFromSource(context, "kernels/daxpy_kernel.cl");
-    CONTROL("clBuildProgram", clBuildProgram(program, 1, &dev_pair.second, nullptr, nullptr, nullptr));
-
+void daxpy_cl(int n, double a, DeviceArray<double>& x, int incx, DeviceArray<double>& y, int incy, Session& session, timer& time) {
+    cl_program program = session.getProgram("kernels/daxpy_kernel.cl");
     cl_kernel kernel = clCreateKernel(program, "daxpy", NULL);
 
-    cl_mem y_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(double) * incy * n, NULL, NULL);
-    cl_mem x_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(double) * incx * n, NULL, NULL);
-
-    CONTROL("clEnqueueWriteBuffer Y", clEnqueueWriteBuffer(queue, y_buffer, CL_TRUE, 0, sizeof(double) * incy * n, y, 0, NULL, NULL));
-    CONTROL("clEnqueueWriteBuffer X", clEnqueueWriteBuffer(queue, x_buffer, CL_TRUE, 0, sizeof(double) * incx * n, x, 0, NULL, NULL));
-
     CONTROL("clSetKernelArg N", clSetKernelArg(kernel, 0, sizeof(int), &n));
     CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 1, sizeof(double), &a));
-    CONTROL("clSetKernelArg X", clSetKernelArg(kernel, 2, sizeof(cl_mem), &x_buffer));
+    CONTROL("clSetKernelArg X", clSetKernelArg(kernel, 2, sizeof(cl_mem), &x.read()));
     CONTROL("clSetKernelArg INCX", clSetKernelArg(kernel, 3, sizeof(int), &incx));
-    CONTROL("clSetKernelArg Y", clSetKernelArg(kernel, 4, sizeof(cl_mem), &y_buffer));
+    CONTROL("clSetKernelArg Y", clSetKernelArg(kernel, 4, sizeof(cl_mem), &y.readWrite()));
     CONTROL("clSetKernelArg INCY", clSetKernelArg(kernel, 5, sizeof(int), &incy));
 
     size_t group = 256;
     size_t size = (n % group == 0) ? n : n + group - n % group;
 
     time.first = std::chrono::high_resolution_clock::now();
-    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &size, &group, 0, NULL, NULL));
-    CONTROL("clFinisl", clFinish(queue));
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 1, NULL, &size, &group, 0, NULL, NULL));
+    CONTROL("clFinisl", clFinish(session.queue));
     time.second = std::chrono::high_resolution_clock::now();
 
-    clEnqueueReadBuffer(queue, y_buffer, CL_TRUE, 0, sizeof(double) * incy * n, y, 0, NULL, NULL);
-
-    clReleaseMemObject(y_buffer);
-    clReleaseMemObject(x_buffer);
-    clReleaseProgram(program);
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
+}
+
+template <typename T>
+using HostAxpy = void (*)(const int&, const T, const T*, const int&, T*, const int&);
+template <typename T>
+using DeviceAxpy = void (*)(int, T, DeviceArray<T>&, int, DeviceArray<T>&, int, Session&, timer&);
+
+// Runs a chunk on the device: upload x and y, the kernel, read y back
+template <typename T>
+static void axpyChunk(DeviceAxpy<T> axpy, int n, T a, const T* x, int incx, T* y, int incy, Session& session) {
+    DeviceArray<T> x_array(session, const_cast<T*>(x), incx * n);
+    DeviceArray<T> y_array(session, y, incy * n);
+    timer time;
+    axpy(n, a, x_array, incx, y_array, incy, session, time);
+    y_array.host();
+}
+
+template <typename T>
+static void axpyHetero(HostAxpy<T> host_axpy, DeviceAxpy<T> device_axpy, int n, T a, const T* x, int incx, T* y, int incy,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::vector<std::pair<cl_platform_id, cl_device_id>>& gpu_dev_pairs,
+    timer& time, std::vector<int>& bounds) {
+    // Paths: the host threads (no session), the CPU device, the GPUs
+    std::vector<std::unique_ptr<Session>> sessions;
+    sessions.emplace_back(nullptr);
+    sessions.emplace_back(new Session(cpu_dev_pair));
+    for (auto& gpu_dev_pair : gpu_dev_pairs)
+        sessions.emplace_back(new Session(gpu_dev_pair));
+    const size_t paths = sessions.size();
+
+    // Probe: the same small update on every path, the first run of a device builds its program
+    const int probe = std::min(n, AXPY_PROBE);
+    std::vector<T> x_probe(x, x + probe * incx), y_probe(y, y + probe * incy);
+    auto seconds = [](std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+    std::vector<double> bandwidth(paths, 0.0);
+    double total = 0.0;
+    for (size_t path = 0; path < paths; ++path) {
+        for (int run = 0; run < 2; ++run) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            if (!sessions[path])
+                host_axpy(probe, a, x_probe.data(), incx, y_probe.data(), incy);
+            else
+                axpyChunk(device_axpy, probe, a, x_probe.data(), incx, y_probe.data(), incy, *sessions[path]);
+            bandwidth[path] = 3.0 * sizeof(T) * probe / std::max(seconds(start), 1e-9);
+        }
+        total += bandwidth[path];
+    }
+
+    bounds.assign(paths + 1, 0);
+    double prefix = 0.0;
+    for (size_t path = 0; path + 1 < paths; ++path) {
+        prefix += bandwidth[path];
+        bounds[path + 1] = std::max(bounds[path], static_cast<int>(n * (prefix / total)));
+    }
+    bounds[paths] = n;
+
+    std::vector<std::exception_ptr> failures(paths);
+    time.first = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> devices;
+    for (size_t path = 1; path < paths; ++path) {
+        const int begin = bounds[path], count = bounds[path + 1] - bounds[path];
+        if (count == 0)
+            continue;
+        devices.emplace_back([&, path, begin, count]() {
+            try {
+                axpyChunk(device_axpy, count, a, x + begin * incx, incx, y + begin * incy, incy, *sessions[path]);
+            }
+            catch (...) {
+                failures[path] = std::current_exception();
+            }
+        });
+    }
+    if (bounds[1] > 0)
+        host_axpy(bounds[1], a, x, incx, y, incy);
+    for (auto& device : devices)
+        device.join();
+    time.second = std::chrono::high_resolution_clock::now();
+
+    for (auto& failure : failures)
+        if (failure)
+            std::rethrow_exception(failure);
+}
+
+void saxpy_hetero(int n, float a, const float* x, int incx, float* y, int incy,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::vector<std::pair<cl_platform_id, cl_device_id>>& gpu_dev_pairs,
+    timer& time, std::vector<int>& bounds) {
+    axpyHetero<float>(saxpy_omp, saxpy_cl, n, a, x, incx, y, incy, cpu_dev_pair, gpu_dev_pairs, time, bounds);
+}
+
+void daxpy_hetero(int n, double a, const double* x, int incx, double* y, int incy,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::vector<std::pair<cl_platform_id, cl_device_id>>& gpu_dev_pairs,
+    timer& time, std::vector<int>& bounds) {
+    axpyHetero<double>(daxpy_omp, daxpy_cl, n, a, x, incx, y, incy, cpu_dev_pair, gpu_dev_pairs, time, bounds);
 }
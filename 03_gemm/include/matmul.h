@@ -4,19 +4,59 @@
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #define THREADS 6
 #define BLOCK 16
+#define STRASSEN_CROSSOVER 512
 
+#include <algorithm>
 #include <vector>
 #include "CL/cl.h"
 #include "utils.h"
+#include "device_array.h"
+
+enum GemmSchedule {
+	GEMM_SCHEDULE_AUTO,
+	GEMM_SCHEDULE_CLASSIC,  // one work-group per output tile
+	GEMM_SCHEDULE_SPLIT_K,  // the inner dimension of every tile is split into equal parts
+	GEMM_SCHEDULE_STREAM_K  // the inner-loop iterations of all tiles are divided evenly between work-groups
+};
 
 void matmul(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c);
 void matmul_omp(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c);
 void matmul_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
 	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time);
+void matmul_cl(const size_t m, const size_t n, const size_t k, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& c,
+	Session& session, timer& time);
 
+// pipelined = true - the software-pipelined kernel with double-buffered local tiles
 void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
-	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time);
+	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, const bool pipelined = false);
+void gemm_cl(const size_t m, const size_t n, const size_t k, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& c,
+	Session& session, timer& time, const bool pipelined = false);
+// Reads A and B as images, so it has no DeviceArray overload: resident buffers would be copied
+// into images on every call
 void gemm_image_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
 	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time);
 
+// Strassen-Winograd recursion over the blocked device GEMM for square n x n matrices.
+// Recursion stops at `crossover` (or when a half is not a multiple of BLOCK).
+// If `error_growth` isn't null, the result is compared with the classical device GEMM
+// and the relative max-norm difference is stored there.
+void gemm_strassen_cl(const size_t n, const float* a, const float* b, float* c,
+	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time,
+	const size_t crossover = STRASSEN_CROSSOVER, float* error_growth = nullptr);
+void gemm_strassen_cl(const size_t n, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& c,
+	Session& session, timer& time, const size_t crossover = STRASSEN_CROSSOVER, float* error_growth = nullptr);
+
+// Out-of-core GEMM: A and B are streamed by panels through double-buffered device tiles,
+// C tiles are accumulated on the device. `tile` = 0 - the tile is chosen from the device memory limits.
+void gemm_ooc_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, const size_t tile = 0);
+
+// GEMM for skinny outputs with a large inner dimension: the reduction is partitioned across work-groups
+// and the partial tiles are combined by a deterministic reduction pass.
+// GEMM_SCHEDULE_AUTO picks the schedule from the shape and the count of compute units.
+void gemm_splitk_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, GemmSchedule schedule = GEMM_SCHEDULE_AUTO);
+void gemm_splitk_cl(const size_t m, const size_t n, const size_t k, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& c,
+	Session& session, timer& time, GemmSchedule schedule = GEMM_SCHEDULE_AUTO);
+
 #endif _GPU_MATMUL_H_
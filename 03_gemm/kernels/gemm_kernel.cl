@@ -22,6 +22,69 @@ __kernel void gemm(const unsigned int m, const unsigned int n, const unsigned in
 	c[global_i * k + global_j] = result;
 }
 
+// Software-pipelined variant of `gemm`: tile t + 1 is prefetched into registers while tile t is multiplied
+// and stored into the second local buffer afterwards, so there is one barrier per tile instead of two.
+__kernel void gemm_pipelined(const unsigned int m, const unsigned int n, const unsigned int k, __global float* a, __global float* b, __global float* c) {
+	const unsigned int i = get_local_id(1);  // m
+	const unsigned int j = get_local_id(0);  // k
+	const unsigned int global_i = get_global_id(1);  // m
+	const unsigned int global_j = get_global_id(0);  // k
+	__local float local_a[2][BLOCK][BLOCK];
+	__local float local_b[2][BLOCK][BLOCK];
+	const unsigned int num_tiles = n / BLOCK;
+	float result = .0;
+	local_a[0][i][j] = a[global_i * n + j];
+	local_b[0][i][j] = b[i * k + global_j];
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (unsigned int t = 0; t < num_tiles; t++) {
+		const unsigned int cur = t % 2;
+		const bool has_next = t + 1 < num_tiles;
+		float next_a = .0, next_b = .0;
+		if (has_next) {
+			next_a = a[global_i * n + BLOCK * (t + 1) + j];
+			next_b = b[(BLOCK * (t + 1) + i) * k + global_j];
+		}
+		for (unsigned int l = 0; l < BLOCK; l++) {
+			result += local_a[cur][i][l] * local_b[cur][l][j];
+		}
+		// Nobody reads the other buffer now: its last readers passed the previous barrier
+		if (has_next) {
+			local_a[1 - cur][i][j] = next_a;
+			local_b[1 - cur][i][j] = next_b;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	c[global_i * k + global_j] = result;
+}
+
+// The same blocked GEMM, but the result can be accumulated into c: c = a * b + (accumulate ? c : 0)
+__kernel void gemm_acc(const unsigned int m, const unsigned int n, const unsigned int k, __global float* a, __global float* b, __global float* c, const int accumulate) {
+	const unsigned int i = get_local_id(1);  // m
+	const unsigned int j = get_local_id(0);  // k
+	const unsigned int global_i = get_global_id(1);  // m
+	const unsigned int global_j = get_global_id(0);  // k
+	__local float local_a[BLOCK][BLOCK];
+	__local float local_b[BLOCK][BLOCK];
+	const unsigned int num_tiles = n / BLOCK;
+	float result = .0;
+	for (unsigned int t = 0; t < num_tiles; t++) {
+		const unsigned int tiled_i = BLOCK * t + i;
+		const unsigned int tiled_j = BLOCK * t + j;
+		local_a[i][j] = a[global_i * n + tiled_j];
+		local_b[i][j] = b[tiled_i * k + global_j];
+		barrier(CLK_LOCAL_MEM_FENCE);
+		for (unsigned int l = 0; l < BLOCK; l++) {
+			result += local_a[i][l] * local_b[l][j];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (accumulate)
+		result += c[global_i * k + global_j];
+	c[global_i * k + global_j] = result;
+}
+
 __kernel void gemm_image(const unsigned int m, const unsigned int n, const unsigned int k, __read_only image2d_t a, __read_only image2d_t b, __write_only image2d_t c) {
 	const unsigned int i = get_local_id(1);  // n
 	const unsigned int j = get_local_id(0);  // k
@@ -48,3 +111,46 @@ __kernel void gemm_image(const unsigned int m, const unsigned int n, const unsig
 	const int2 idx_c = { global_i, global_j };
     write_imagef(c, idx_c, value);  
 }
+
+// Split-K / stream-K GEMM. A segment is a range [seg_begin, seg_end) of BLOCK-wide steps of the inner
+// dimension for one output tile. Work-group g processes the segments [wg_first[g], wg_first[g + 1]),
+// the partial tile of every segment is stored in partials and summed by gemm_segments_reduce.
+__kernel void gemm_segments(const unsigned int m, const unsigned int n, const unsigned int k, __global float* a, __global float* b,
+	__global float* partials, __global const int* seg_tile, __global const int* seg_begin, __global const int* seg_end, __global const int* wg_first) {
+	const unsigned int i = get_local_id(1);
+	const unsigned int j = get_local_id(0);
+	const unsigned int g = get_group_id(0);
+	const unsigned int tiles_k = k / BLOCK;
+	__local float local_a[BLOCK][BLOCK];
+	__local float local_b[BLOCK][BLOCK];
+	for (int s = wg_first[g]; s < wg_first[g + 1]; s++) {
+		const unsigned int global_i = (seg_tile[s] / tiles_k) * BLOCK + i;
+		const unsigned int global_j = (seg_tile[s] % tiles_k) * BLOCK + j;
+		float result = .0;
+		for (int t = seg_begin[s]; t < seg_end[s]; t++) {
+			const unsigned int tiled_i = BLOCK * t + i;
+			const unsigned int tiled_j = BLOCK * t + j;
+			local_a[i][j] = a[global_i * n + tiled_j];
+			local_b[i][j] = b[tiled_i * k + global_j];
+			barrier(CLK_LOCAL_MEM_FENCE);
+			for (unsigned int l = 0; l < BLOCK; l++) {
+				result += local_a[i][l] * local_b[l][j];
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+		partials[(s * BLOCK + i) * BLOCK + j] = result;
+	}
+}
+
+// Deterministic fix-up: the segments of a tile are summed in a fixed order
+__kernel void gemm_segments_reduce(const unsigned int k, __global float* c, __global const float* partials, __global const int* tile_first) {
+	const unsigned int global_i = get_global_id(1);
+	const unsigned int global_j = get_global_id(0);
+	const unsigned int tile = (global_i / BLOCK) * (k / BLOCK) + global_j / BLOCK;
+	const unsigned int offset = (global_i % BLOCK) * BLOCK + global_j % BLOCK;
+	float result = .0;
+	for (int s = tile_first[tile]; s < tile_first[tile + 1]; s++) {
+		result += partials[s * BLOCK * BLOCK + offset];
+	}
+	c[global_i * k + global_j] = result;
+}
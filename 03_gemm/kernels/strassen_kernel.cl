@@ -0,0 +1,46 @@
+// Every matrix is passed as a view: buffer + offset (in elements) + leading dimension,
+// so quadrants of A, B, C and blocks of the workspace arena are addressed without copies.
+
+__kernel void matrix_add(__global const float* x, const unsigned int x_off, const unsigned int ldx,
+                         __global const float* y, const unsigned int y_off, const unsigned int ldy,
+                         __global float* z, const unsigned int z_off, const unsigned int ldz) {
+    const unsigned int i = get_global_id(1);
+    const unsigned int j = get_global_id(0);
+    z[z_off + i * ldz + j] = x[x_off + i * ldx + j] + y[y_off + i * ldy + j];
+}
+
+__kernel void matrix_sub(__global const float* x, const unsigned int x_off, const unsigned int ldx,
+                         __global const float* y, const unsigned int y_off, const unsigned int ldy,
+                         __global float* z, const unsigned int z_off, const unsigned int ldz) {
+    const unsigned int i = get_global_id(1);
+    const unsigned int j = get_global_id(0);
+    z[z_off + i * ldz + j] = x[x_off + i * ldx + j] - y[y_off + i * ldy + j];
+}
+
+// Blocked GEMM (the same tiling as `gemm`) on views: c = a * b, n - inner dimension
+__kernel void gemm_view(const unsigned int n,
+                        __global const float* a, const unsigned int a_off, const unsigned int lda,
+                        __global const float* b, const unsigned int b_off, const unsigned int ldb,
+                        __global float* c, const unsigned int c_off, const unsigned int ldc) {
+    const unsigned int i = get_local_id(1);
+    const unsigned int j = get_local_id(0);
+    const unsigned int global_i = get_global_id(1);
+    const unsigned int global_j = get_global_id(0);
+    __local float local_a[BLOCK][BLOCK];
+    __local float local_b[BLOCK][BLOCK];
+    const unsigned int num_tiles = n / BLOCK;
+    float result = .0f;
+    for (unsigned int t = 0; t < num_tiles; t++) {
+        const unsigned int tiled_i = BLOCK * t + i;
+        const unsigned int tiled_j = BLOCK * t + j;
+        local_a[i][j] = a[a_off + global_i * lda + tiled_j];
+        local_b[i][j] = b[b_off + tiled_i * ldb + global_j];
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (unsigned int l = 0; l < BLOCK; l++) {
+            result += local_a[i][l] * local_b[l][j];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    c[c_off + global_i * ldc + global_j] = result;
+}
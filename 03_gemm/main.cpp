@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <chrono>
 #include <string>
@@ -12,6 +13,10 @@
 #define M 720
 #define N 720
 #define K 720
+#define STRASSEN_N 2048
+#define OOC_TILE 256
+#define SKINNY_MK 128
+#define SKINNY_N 65536
 
 
 int main(int argc, char** argv) {
@@ -151,5 +156,124 @@ int main(int argc, char** argv) {
         std::cout << exception.what() << std::endl;
     }
 
+    //************************************************************************************
+    // TASK 4
+    //************************************************************************************
+    std::cout << "===========================" << std::endl
+        << "\tTASK 4 GEMM Strassen-Winograd" << std::endl
+        << "===========================" << std::endl;
+    try {
+        const size_t s_size = STRASSEN_N * STRASSEN_N;
+        std::vector<float> s_a(s_size), s_b(s_size), s_c(s_size);
+        fillData<float>(s_a.data(), s_size);
+        fillData<float>(s_b.data(), s_size);
+
+        // CL GPU
+        for (int i = 0; i < gpus.size(); i++) {
+            timer time;
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (size_t crossover : { static_cast<size_t>(STRASSEN_N), static_cast<size_t>(STRASSEN_CROSSOVER), static_cast<size_t>(256) }) {
+                float error_growth = 0.f;
+                gemm_strassen_cl(STRASSEN_N, s_a.data(), s_b.data(), s_c.data(), gpus[i], time, crossover, &error_growth);
+                std::cout << "Time 'GPU' (device " << name << "), crossover " << crossover << ": " << TIME_MS(time.first, time.second) << std::endl;
+            }
+        }
+    }
+    catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    //************************************************************************************
+    // TASK 5
+    //************************************************************************************
+    std::cout << "===========================" << std::endl
+        << "\tTASK 5 GEMM out-of-core" << std::endl
+        << "===========================" << std::endl;
+    try {
+        // CL GPU
+        for (int i = 0; i < gpus.size(); i++) {
+            timer time;
+            gemm_ooc_cl(M, N, K, a, b, c, gpus[i], time, OOC_TILE);
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            std::cout << "Time 'GPU' (device " << name << "): " << TIME_MS(time.first, time.second) << std::endl;
+            CHECK(FLAG_CHECK, float, c_ref, c, c_size)
+        }
+    }
+    catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    //************************************************************************************
+    // TASK 6
+    //************************************************************************************
+    std::cout << "===========================" << std::endl
+        << "\tTASK 6 GEMM split-K / stream-K" << std::endl
+        << "===========================" << std::endl;
+    try {
+        std::vector<float> k_a(SKINNY_MK * SKINNY_N), k_b(SKINNY_N * SKINNY_MK);
+        std::vector<float> k_c(SKINNY_MK * SKINNY_MK), k_ref(SKINNY_MK * SKINNY_MK);
+        fillData<float>(k_a.data(), k_a.size());
+        fillData<float>(k_b.data(), k_b.size());
+
+        // CL GPU
+        for (int i = 0; i < gpus.size(); i++) {
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (GemmSchedule schedule : { GEMM_SCHEDULE_CLASSIC, GEMM_SCHEDULE_SPLIT_K, GEMM_SCHEDULE_STREAM_K, GEMM_SCHEDULE_AUTO }) {
+                timer time;
+                gemm_splitk_cl(SKINNY_MK, SKINNY_N, SKINNY_MK, k_a.data(), k_b.data(), k_c.data(), gpus[i], time, schedule);
+                std::cout << "Time 'GPU' (device " << name << "): " << TIME_MS(time.first, time.second) << std::endl;
+                if (schedule == GEMM_SCHEDULE_CLASSIC) {
+                    k_ref = k_c;
+                    continue;
+                }
+                float max_diff = 0.f;
+                for (size_t j = 0; j < k_c.size(); ++j)
+                    max_diff = std::max(max_diff, std::abs(k_c[j] - k_ref[j]) / std::max(std::abs(k_ref[j]), 1e-6f));
+                std::cout << "-- Relative difference vs classic: " << max_diff << std::endl;
+            }
+        }
+    }
+    catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    //************************************************************************************
+    // TASK 7
+    //************************************************************************************
+    std::cout << "===========================" << std::endl
+        << "\tTASK 7 GEMM software-pipelined" << std::endl
+        << "===========================" << std::endl;
+    try {
+        // CL GPU
+        for (int i = 0; i < gpus.size(); i++) {
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (bool pipelined : { false, true }) {
+                timer time;
+                gemm_cl(M, N, K, a, b, c, gpus[i], time, pipelined);
+                std::cout << "Time 'GPU' (device " << name << ", " << (pipelined ? "pipelined" : "basic") << "): " << TIME_MS(time.first, time.second) << std::endl;
+                CHECK(FLAG_CHECK, float, c_ref, c, c_size)
+            }
+        }
+
+        // CL CPU
+        for (int i = 0; i < cpus.size(); i++) {
+            char name[128];
+            clGetDeviceInfo(cpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (bool pipelined : { false, true }) {
+                timer time;
+                gemm_cl(M, N, K, a, b, c, cpus[i], time, pipelined);
+                std::cout << "Time 'CPU' (device " << name << ", " << (pipelined ? "pipelined" : "basic") << "): " << TIME_MS(time.first, time.second) << std::endl;
+                CHECK(FLAG_CHECK, float, c_ref, c, c_size)
+            }
+        }
+    }
+    catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
     return 0;
 }
\ No newline at end of file
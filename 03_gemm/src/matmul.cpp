@@ -28,127 +28,79 @@ void matmul_omp(const size_t m, const size_t n, const size_t k, const float* a,
 void matmul_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
 	std::pair<cl_platform_id, cl_device_id>& dev_pair,
 	timer& time) {
-    cl_int error = CL_SUCCESS;
-    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)dev_pair.first, 0 };
-
-    cl_context context = clCreateContext(properties, 1, &dev_pair.second, nullptr, nullptr, &error);
-    CONTROL("clCreateContext", error);
+    Session session(dev_pair);
+    DeviceArray<float> a_array(session, const_cast<float*>(a), m * n);
+    DeviceArray<float> b_array(session, const_cast<float*>(b), n * k);
+    DeviceArray<float> c_array(session, c, m * k);
 
-    cl_command_queue queue = clCreateCommandQueue(context, dev_pair.second, 0, &error);
-    CONTROL("clCreateCommandQueuC", error);
+    matmul_cl(m, n, k, a_array, b_array, c_array, session, time);
+    c_array.host();
+}
 
-    cl_program program = createProgramFromSource(context, "kernels/matmul_kernel.cl");
-    CONTROL("clBuildProgram", clBuildProgram(program, 1, &dev_pair.second, nullptr, nullptr, nullptr));
+void matmul_cl(const size_t m, const size_t n, const size_t k, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& c,
+    Session& session, timer& time) {
+    cl_int error = CL_SUCCESS;
+    cl_program program = session.getProgram("kernels/matmul_kernel.cl");
 
     cl_kernel kernel = clCreateKernel(program, "matmul", &error);
     CONTROL("clCreateKernel", error);
 
-    cl_mem a_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * m * n, nullptr, &error);
-    CONTROL("clCreateBuffer A", error);
-    cl_mem b_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * n * k, nullptr, &error);
-    CONTROL("clCreateBuffer B", error);
-    cl_mem c_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * m * k, nullptr, &error);
-    CONTROL("clCreateBuffer C", error);
-
-    CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(queue, a_buffer, CL_TRUE, 0, sizeof(float) * m * n, a, 0, nullptr, nullptr));
-    CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(queue, b_buffer, CL_TRUE, 0, sizeof(float) * n * k, b, 0, nullptr, nullptr));
-
     CONTROL("clSetKernelArg M", clSetKernelArg(kernel, 0, sizeof(unsigned int), &m));
     CONTROL("clSetKernelArg N", clSetKernelArg(kernel, 1, sizeof(unsigned int), &n));
     CONTROL("clSetKernelArg K", clSetKernelArg(kernel, 2, sizeof(unsigned int), &k));
-    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 3, sizeof(cl_mem), &a_buffer));
-    CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 4, sizeof(cl_mem), &b_buffer));
-    CONTROL("clSetKernelArg C", clSetKernelArg(kernel, 5, sizeof(cl_mem), &c_buffer));
+    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 3, sizeof(cl_mem), &a.read()));
+    CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 4, sizeof(cl_mem), &b.read()));
+    CONTROL("clSetKernelArg C", clSetKernelArg(kernel, 5, sizeof(cl_mem), &c.write()));
 
-    size_t group = 16;
-    CONTROL("clGetKernelWorkGroupInf", clGetKernelWorkGroupInfo(kernel, dev_pair.second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &group, nullptr));
-
-	size_t* global = new size_t[2];
-	global[0] = m;
-	global[1] = k;
-
-	size_t* local = new size_t[2];
-	local[0] = static_cast<size_t>(BLOCK);
-	local[1] = static_cast<size_t>(BLOCK);
+    const size_t ndims = 2;
+    const size_t global[ndims] = { m, k };
+    const size_t local[ndims] = { BLOCK, BLOCK };
 
-	const size_t ndims = 2;
     time.first = std::chrono::high_resolution_clock::now();
-    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(queue, kernel, ndims, nullptr, global, local, 0, nullptr, nullptr));
-    CONTROL("clFinish", clFinish(queue));
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, ndims, nullptr, global, local, 0, nullptr, nullptr));
+    CONTROL("clFinish", clFinish(session.queue));
     time.second = std::chrono::high_resolution_clock::now();
 
-    clEnqueueReadBuffer(queue, c_buffer, CL_TRUE, 0, sizeof(float) * m * k, c, 0, nullptr, nullptr);
-
-    clReleaseMemObject(a_buffer);
-    clReleaseMemObject(b_buffer);
-    clReleaseMemObject(c_buffer);
-    clReleaseProgram(program);
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
 }
 
 void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
-    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time) {
-        cl_int error = CL_SUCCESS;
-        cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)dev_pair.first, 0 };
-
-        cl_context context = clCreateContext(properties, 1, &dev_pair.second, nullptr, nullptr, &error);
-        CONTROL("clCreateContext", error);
-
-        cl_command_queue queue = clCreateCommandQueue(context, dev_pair.second, 0, &error);
-        CONTROL("clCreateCommandQueuC", error);
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, const bool pipelined) {
+        Session session(dev_pair);
+        DeviceArray<float> a_array(session, const_cast<float*>(a), m * n);
+        DeviceArray<float> b_array(session, const_cast<float*>(b), n * k);
+        DeviceArray<float> c_array(session, c, m * k);
+
+        gemm_cl(m, n, k, a_array, b_array, c_array, session, time, pipelined);
+        c_array.host();
+}
 
-        cl_program program = createProgramFromSource(context, "kernels/gemm_kernel.cl");
+void gemm_cl(const size_t m, const size_t n, const size_t k, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& c,
+    Session& session, timer& time, const bool pipelined) {
+        cl_int error = CL_SUCCESS;
         std::string build_options = "-DBLOCK=" + std::to_string(BLOCK);
-        CONTROL("clBuildProgram", clBuildProgram(program, 1, &dev_pair.second, build_options.c_str(), nullptr, nullptr));
+        cl_program program = session.getProgram("kernels/gemm_kernel.cl", build_options);
 
-        cl_kernel kernel = clCreateKernel(program, "gemm", &error);
+        cl_kernel kernel = clCreateKernel(program, pipelined ? "gemm_pipelined" : "gemm", &error);
         CONTROL("clCreateKernel", error);
 
-        cl_mem a_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * m * n, nullptr, &error);
-        CONTROL("clCreateBuffer A", error);
-        cl_mem b_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * n * k, nullptr, &error);
-        CONTROL("clCreateBuffer B", error);
-        cl_mem c_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * m * k, nullptr, &error);
-        CONTROL("clCreateBuffer C", error);
-
-        CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(queue, a_buffer, CL_TRUE, 0, sizeof(float)* m* n, a, 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(queue, b_buffer, CL_TRUE, 0, sizeof(float)* n* k, b, 0, nullptr, nullptr));
-
         CONTROL("clSetKernelArg M", clSetKernelArg(kernel, 0, sizeof(unsigned int), &m));
         CONTROL("clSetKernelArg N", clSetKernelArg(kernel, 1, sizeof(unsigned int), &n));
         CONTROL("clSetKernelArg K", clSetKernelArg(kernel, 2, sizeof(unsigned int), &k));
-        CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 3, sizeof(cl_mem), &a_buffer));
-        CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 4, sizeof(cl_mem), &b_buffer));
-        CONTROL("clSetKernelArg C", clSetKernelArg(kernel, 5, sizeof(cl_mem), &c_buffer));
-
-        size_t group = 16;
-        CONTROL("clGetKernelWorkGroupInf", clGetKernelWorkGroupInfo(kernel, dev_pair.second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &group, nullptr));
-
-        size_t* global = new size_t[2];
-        global[0] = k;
-        global[1] = m;
-
-        size_t* local = new size_t[2];
-        local[0] = static_cast<size_t>(BLOCK);
-        local[1] = static_cast<size_t>(BLOCK);
+        CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 3, sizeof(cl_mem), &a.read()));
+        CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 4, sizeof(cl_mem), &b.read()));
+        CONTROL("clSetKernelArg C", clSetKernelArg(kernel, 5, sizeof(cl_mem), &c.write()));
 
         const size_t ndims = 2;
+        const size_t global[ndims] = { k, m };
+        const size_t local[ndims] = { BLOCK, BLOCK };
+
         time.first = std::chrono::high_resolution_clock::now();
-        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(queue, kernel, ndims, nullptr, global, local, 0, nullptr, nullptr));
-        CONTROL("clFinish", clFinish(queue));
+        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, ndims, nullptr, global, local, 0, nullptr, nullptr));
+        CONTROL("clFinish", clFinish(session.queue));
         time.second = std::chrono::high_resolution_clock::now();
 
-        clEnqueueReadBuffer(queue, c_buffer, CL_TRUE, 0, sizeof(float)* m * k, c, 0, nullptr, nullptr);
-
-        clReleaseMemObject(a_buffer);
-        clReleaseMemObject(b_buffer);
-        clReleaseMemObject(c_buffer);
-        clReleaseProgram(program);
         clReleaseKernel(kernel);
-        clReleaseCommandQueue(queue);
-        clReleaseContext(context);
 }
 
 void gemm_image_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
@@ -162,8 +114,8 @@ void gemm_image_cl(const size_t m, const size_t n, const size_t k, const float*
     cl_command_queue queue = clCreateCommandQueue(context, dev_pair.second, 0, &error);
     CONTROL("clCreateCommandQueuC", error);
 
-    cl_program program = createProgramFromSource(context, "kernels/gemm_kernel.cl");
     std::string build_options = "-DBLOCK=" + std::to_string(BLOCK);
+    cl_program program = createProgram(context, dev_pair.second, "kernels/gemm_kernel.cl", build_options);
     CONTROL("clBuildProgram", clBuildProgram(program, 1, &dev_pair.second, build_options.c_str(), nullptr, nullptr));
 
     cl_kernel kernel = clCreateKernel(program, "gemm_image", &error);
@@ -213,3 +165,472 @@ void gemm_image_cl(const size_t m, const size_t n, const size_t k, const float*
     clReleaseCommandQueue(queue);
     clReleaseContext(context);
 }
+
+// ------------------------------------------------------------------------------------
+// Strassen-Winograd
+struct MatrixView {
+    cl_mem buffer;
+    size_t offset;
+    size_t ld;
+
+    MatrixView quadrant(const size_t row, const size_t col, const size_t half) const {
+        return { buffer, offset + row * half * ld + col * half, ld };
+    }
+};
+
+struct StrassenContext {
+    cl_command_queue queue;
+    cl_kernel add;
+    cl_kernel sub;
+    cl_kernel gemm;
+    cl_mem arena;
+    std::vector<size_t> level_offsets;
+    size_t crossover;
+};
+
+static bool isStrassenStep(const size_t dim, const size_t crossover) {
+    return dim > crossover && dim % (2 * BLOCK) == 0;
+}
+
+static void setViewArgs(cl_kernel kernel, const cl_uint idx, const MatrixView& view) {
+    const unsigned int offset = static_cast<unsigned int>(view.offset);
+    const unsigned int ld = static_cast<unsigned int>(view.ld);
+    CONTROL("clSetKernelArg View", clSetKernelArg(kernel, idx, sizeof(cl_mem), &view.buffer));
+    CONTROL("clSetKernelArg Offset", clSetKernelArg(kernel, idx + 1, sizeof(unsigned int), &offset));
+    CONTROL("clSetKernelArg LD", clSetKernelArg(kernel, idx + 2, sizeof(unsigned int), &ld));
+}
+
+static void enqueueElementwise(const StrassenContext& ctx, cl_kernel kernel, const size_t dim,
+    const MatrixView& x, const MatrixView& y, const MatrixView& z) {
+    setViewArgs(kernel, 0, x);
+    setViewArgs(kernel, 3, y);
+    setViewArgs(kernel, 6, z);
+    const size_t global[2] = { dim, dim };
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(ctx.queue, kernel, 2, nullptr, global, nullptr, 0, nullptr, nullptr));
+}
+
+static void enqueueGemmView(const StrassenContext& ctx, const size_t dim, const MatrixView& a, const MatrixView& b, const MatrixView& c) {
+    const unsigned int n = static_cast<unsigned int>(dim);
+    CONTROL("clSetKernelArg N", clSetKernelArg(ctx.gemm, 0, sizeof(unsigned int), &n));
+    setViewArgs(ctx.gemm, 1, a);
+    setViewArgs(ctx.gemm, 4, b);
+    setViewArgs(ctx.gemm, 7, c);
+    const size_t global[2] = { dim, dim };
+    const size_t local[2] = { BLOCK, BLOCK };
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(ctx.queue, ctx.gemm, 2, nullptr, global, local, 0, nullptr, nullptr));
+}
+
+// C = A * B with the memory-efficient schedule of Winograd's variant (7 products, 15 additions):
+// two temporaries X and Y per recursion level, both taken from the preallocated arena.
+static void strassenWinograd(const StrassenContext& ctx, const size_t level, const size_t dim,
+    const MatrixView& a, const MatrixView& b, const MatrixView& c) {
+    if (!isStrassenStep(dim, ctx.crossover)) {
+        enqueueGemmView(ctx, dim, a, b, c);
+        return;
+    }
+
+    const size_t h = dim / 2;
+    const MatrixView a11 = a.quadrant(0, 0, h), a12 = a.quadrant(0, 1, h), a21 = a.quadrant(1, 0, h), a22 = a.quadrant(1, 1, h);
+    const MatrixView b11 = b.quadrant(0, 0, h), b12 = b.quadrant(0, 1, h), b21 = b.quadrant(1, 0, h), b22 = b.quadrant(1, 1, h);
+    const MatrixView c11 = c.quadrant(0, 0, h), c12 = c.quadrant(0, 1, h), c21 = c.quadrant(1, 0, h), c22 = c.quadrant(1, 1, h);
+    const MatrixView x = { ctx.arena, ctx.level_offsets[level], h };
+    const MatrixView y = { ctx.arena, ctx.level_offsets[level] + h * h, h };
+
+    enqueueElementwise(ctx, ctx.sub, h, a11, a21, x);    // S3 = A11 - A21
+    enqueueElementwise(ctx, ctx.sub, h, b22, b12, y);    // T3 = B22 - B12
+    strassenWinograd(ctx, level + 1, h, x, y, c21);      // P7 = S3 * T3
+    enqueueElementwise(ctx, ctx.add, h, a21, a22, x);    // S1 = A21 + A22
+    enqueueElementwise(ctx, ctx.sub, h, b12, b11, y);    // T1 = B12 - B11
+    strassenWinograd(ctx, level + 1, h, x, y, c22);      // P5 = S1 * T1
+    enqueueElementwise(ctx, ctx.sub, h, x, a11, x);      // S2 = S1 - A11
+    enqueueElementwise(ctx, ctx.sub, h, b22, y, y);      // T2 = B22 - T1
+    strassenWinograd(ctx, level + 1, h, x, y, c12);      // P6 = S2 * T2
+    enqueueElementwise(ctx, ctx.sub, h, a12, x, x);      // S4 = A12 - S2
+    strassenWinograd(ctx, level + 1, h, x, b22, c11);    // P3 = S4 * B22
+    strassenWinograd(ctx, level + 1, h, a11, b11, x);    // P1 = A11 * B11
+    enqueueElementwise(ctx, ctx.add, h, x, c12, c12);    // U2 = P1 + P6
+    enqueueElementwise(ctx, ctx.add, h, c12, c21, c21);  // U3 = U2 + P7
+    enqueueElementwise(ctx, ctx.add, h, c12, c22, c12);  // U4 = U2 + P5
+    enqueueElementwise(ctx, ctx.add, h, c21, c22, c22);  // U7 = U3 + P5 -> C22
+    enqueueElementwise(ctx, ctx.add, h, c12, c11, c12);  // U5 = U4 + P3 -> C12
+    enqueueElementwise(ctx, ctx.sub, h, y, b21, y);      // T4 = T2 - B21
+    strassenWinograd(ctx, level + 1, h, a22, y, c11);    // P4 = A22 * T4
+    enqueueElementwise(ctx, ctx.sub, h, c21, c11, c21);  // U6 = U3 - P4 -> C21
+    strassenWinograd(ctx, level + 1, h, a12, b21, c11);  // P2 = A12 * B21
+    enqueueElementwise(ctx, ctx.add, h, x, c11, c11);    // U1 = P1 + P2 -> C11
+}
+
+void gemm_strassen_cl(const size_t n, const float* a, const float* b, float* c,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, const size_t crossover, float* error_growth) {
+    Session session(dev_pair);
+    DeviceArray<float> a_array(session, const_cast<float*>(a), n * n);
+    DeviceArray<float> b_array(session, const_cast<float*>(b), n * n);
+    DeviceArray<float> c_array(session, c, n * n);
+
+    gemm_strassen_cl(n, a_array, b_array, c_array, session, time, crossover, error_growth);
+    c_array.host();
+}
+
+void gemm_strassen_cl(const size_t n, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& c,
+    Session& session, timer& time, const size_t crossover, float* error_growth) {
+    cl_int error = CL_SUCCESS;
+    std::string build_options = "-DBLOCK=" + std::to_string(BLOCK);
+    cl_program program = session.getProgram("kernels/strassen_kernel.cl", build_options);
+
+    StrassenContext ctx;
+    ctx.queue = session.queue;
+    ctx.crossover = crossover;
+    ctx.add = clCreateKernel(program, "matrix_add", &error);
+    CONTROL("clCreateKernel matrix_add", error);
+    ctx.sub = clCreateKernel(program, "matrix_sub", &error);
+    CONTROL("clCreateKernel matrix_sub", error);
+    ctx.gemm = clCreateKernel(program, "gemm_view", &error);
+    CONTROL("clCreateKernel gemm_view", error);
+
+    // The whole workspace is allocated once: 2 * (dim / 2)^2 floats per level, i.e. < 2/3 * n^2 in total
+    size_t arena_size = 0;
+    for (size_t dim = n; isStrassenStep(dim, crossover); dim /= 2) {
+        ctx.level_offsets.push_back(arena_size);
+        arena_size += 2 * (dim / 2) * (dim / 2);
+    }
+
+    ctx.arena = nullptr;
+    if (arena_size > 0) {
+        ctx.arena = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(float) * arena_size, nullptr, &error);
+        CONTROL("clCreateBuffer Arena", error);
+    }
+
+    const MatrixView a_view = { a.read(), 0, n };
+    const MatrixView b_view = { b.read(), 0, n };
+    const MatrixView c_view = { c.write(), 0, n };
+
+    time.first = std::chrono::high_resolution_clock::now();
+    strassenWinograd(ctx, 0, n, a_view, b_view, c_view);
+    CONTROL("clFinish", clFinish(session.queue));
+    time.second = std::chrono::high_resolution_clock::now();
+
+    if (error_growth != nullptr) {
+        DeviceArray<float> ref(session, n * n);
+        enqueueGemmView(ctx, n, a_view, b_view, { ref.write(), 0, n });
+        const float* actual = c.host();
+        const float* expected = ref.host();
+
+        float max_diff = 0.f, max_ref = 0.f;
+        for (size_t i = 0; i < n * n; ++i) {
+            max_diff = std::max(max_diff, std::abs(actual[i] - expected[i]));
+            max_ref = std::max(max_ref, std::abs(expected[i]));
+        }
+        *error_growth = (max_ref > 0.f) ? max_diff / max_ref : max_diff;
+        std::cout << "[ INFO ] Strassen-Winograd levels: " << ctx.level_offsets.size()
+            << ", relative error vs classical GEMM: " << *error_growth << std::endl;
+    }
+
+    if (ctx.arena != nullptr)
+        clReleaseMemObject(ctx.arena);
+    clReleaseKernel(ctx.add);
+    clReleaseKernel(ctx.sub);
+    clReleaseKernel(ctx.gemm);
+}
+
+// ------------------------------------------------------------------------------------
+// Out-of-core GEMM
+static size_t chooseOutOfCoreTile(const size_t m, const size_t n, const size_t k, cl_device_id device) {
+    cl_ulong global_mem = 0, max_alloc = 0;
+    CONTROL("clGetDeviceInfo", clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &global_mem, nullptr));
+    CONTROL("clGetDeviceInfo", clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &max_alloc, nullptr));
+
+    // 2 A panels + 2 B panels + 1 C tile live on the device, keep a quarter of the memory free
+    const cl_ulong budget = global_mem / 4 * 3;
+    size_t tile = BLOCK;
+    while (5 * (2 * tile) * (2 * tile) * sizeof(float) <= budget && (2 * tile) * (2 * tile) * sizeof(float) <= max_alloc)
+        tile *= 2;
+
+    return std::min(tile, std::max({ m, n, k }));
+}
+
+void gemm_ooc_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, const size_t tile) {
+    if (m % BLOCK != 0 || n % BLOCK != 0 || k % BLOCK != 0 || tile % BLOCK != 0) {
+        THROW_EXCEPTION(std::string("gemm_ooc_cl"), std::string("Sizes and tile must be multiples of BLOCK"))
+    }
+
+    cl_int error = CL_SUCCESS;
+    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)dev_pair.first, 0 };
+
+    cl_context context = clCreateContext(properties, 1, &dev_pair.second, nullptr, nullptr, &error);
+    CONTROL("clCreateContext", error);
+
+    // Uploads go to their own queue so they overlap with the kernels of the compute queue
+    cl_command_queue compute_queue = clCreateCommandQueue(context, dev_pair.second, 0, &error);
+    CONTROL("clCreateCommandQueue Compute", error);
+    cl_command_queue transfer_queue = clCreateCommandQueue(context, dev_pair.second, 0, &error);
+    CONTROL("clCreateCommandQueue Transfer", error);
+
+    std::string build_options = "-DBLOCK=" + std::to_string(BLOCK);
+    cl_program program = createProgram(context, dev_pair.second, "kernels/gemm_kernel.cl", build_options);
+    CONTROL("clBuildProgram", clBuildProgram(program, 1, &dev_pair.second, build_options.c_str(), nullptr, nullptr));
+
+    cl_kernel kernel = clCreateKernel(program, "gemm_acc", &error);
+    CONTROL("clCreateKernel", error);
+
+    const size_t t = (tile == 0) ? chooseOutOfCoreTile(m, n, k, dev_pair.second) : tile;
+    std::cout << "[ INFO ] Out-of-core tile: " << t << "x" << t << std::endl;
+
+    cl_mem a_buffers[2], b_buffers[2];
+    for (int slot = 0; slot < 2; ++slot) {
+        a_buffers[slot] = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * t * t, nullptr, &error);
+        CONTROL("clCreateBuffer A", error);
+        b_buffers[slot] = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * t * t, nullptr, &error);
+        CONTROL("clCreateBuffer B", error);
+    }
+    cl_mem c_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * t * t, nullptr, &error);
+    CONTROL("clCreateBuffer C", error);
+
+    CONTROL("clSetKernelArg C", clSetKernelArg(kernel, 5, sizeof(cl_mem), &c_buffer));
+
+    const size_t zero_origin[3] = { 0, 0, 0 };
+    cl_event kernel_evts[2] = { nullptr, nullptr };
+    size_t panel = 0;
+
+    time.first = std::chrono::high_resolution_clock::now();
+    for (size_t ti = 0; ti < m; ti += t) {
+        const size_t tm = std::min(t, m - ti);
+        for (size_t tj = 0; tj < k; tj += t) {
+            const size_t tk = std::min(t, k - tj);
+            for (size_t tp = 0; tp < n; tp += t, ++panel) {
+                const size_t tn = std::min(t, n - tp);
+                const int slot = panel % 2;
+
+                // The slot is free once the kernel which used it two panels ago is done
+                const cl_uint wait_count = (kernel_evts[slot] != nullptr) ? 1 : 0;
+                cl_event upload_evts[2];
+                const size_t a_origin[3] = { tp * sizeof(float), ti, 0 };
+                const size_t a_region[3] = { tn * sizeof(float), tm, 1 };
+                CONTROL("clEnqueueWriteBufferRect A", clEnqueueWriteBufferRect(transfer_queue, a_buffers[slot], CL_FALSE, zero_origin, a_origin, a_region,
+                    tn * sizeof(float), 0, n * sizeof(float), 0, a, wait_count, &kernel_evts[slot], &upload_evts[0]));
+                const size_t b_origin[3] = { tj * sizeof(float), tp, 0 };
+                const size_t b_region[3] = { tk * sizeof(float), tn, 1 };
+                CONTROL("clEnqueueWriteBufferRect B", clEnqueueWriteBufferRect(transfer_queue, b_buffers[slot], CL_FALSE, zero_origin, b_origin, b_region,
+                    tk * sizeof(float), 0, k * sizeof(float), 0, b, wait_count, &kernel_evts[slot], &upload_evts[1]));
+                CONTROL("clFlush", clFlush(transfer_queue));
+
+                const unsigned int pm = static_cast<unsigned int>(tm);
+                const unsigned int pn = static_cast<unsigned int>(tn);
+                const unsigned int pk = static_cast<unsigned int>(tk);
+                const int accumulate = (tp > 0) ? 1 : 0;
+                CONTROL("clSetKernelArg M", clSetKernelArg(kernel, 0, sizeof(unsigned int), &pm));
+                CONTROL("clSetKernelArg N", clSetKernelArg(kernel, 1, sizeof(unsigned int), &pn));
+                CONTROL("clSetKernelArg K", clSetKernelArg(kernel, 2, sizeof(unsigned int), &pk));
+                CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 3, sizeof(cl_mem), &a_buffers[slot]));
+                CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 4, sizeof(cl_mem), &b_buffers[slot]));
+                CONTROL("clSetKernelArg Accumulate", clSetKernelArg(kernel, 6, sizeof(int), &accumulate));
+
+                if (kernel_evts[slot] != nullptr)
+                    clReleaseEvent(kernel_evts[slot]);
+                const size_t global[2] = { tk, tm };
+                const size_t local[2] = { BLOCK, BLOCK };
+                CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(compute_queue, kernel, 2, nullptr, global, local, 2, upload_evts, &kernel_evts[slot]));
+                CONTROL("clFlush", clFlush(compute_queue));
+                clReleaseEvent(upload_evts[0]);
+                clReleaseEvent(upload_evts[1]);
+            }
+
+            // The compute queue is in-order: the next tile's first kernel starts after this read
+            const size_t c_origin[3] = { tj * sizeof(float), ti, 0 };
+            const size_t c_region[3] = { tk * sizeof(float), tm, 1 };
+            CONTROL("clEnqueueReadBufferRect C", clEnqueueReadBufferRect(compute_queue, c_buffer, CL_FALSE, zero_origin, c_origin, c_region,
+                tk * sizeof(float), 0, k * sizeof(float), 0, c, 0, nullptr, nullptr));
+        }
+    }
+    CONTROL("clFinish", clFinish(compute_queue));
+    CONTROL("clFinish", clFinish(transfer_queue));
+    time.second = std::chrono::high_resolution_clock::now();
+
+    for (int slot = 0; slot < 2; ++slot) {
+        if (kernel_evts[slot] != nullptr)
+            clReleaseEvent(kernel_evts[slot]);
+        clReleaseMemObject(a_buffers[slot]);
+        clReleaseMemObject(b_buffers[slot]);
+    }
+    clReleaseMemObject(c_buffer);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+    clReleaseCommandQueue(compute_queue);
+    clReleaseCommandQueue(transfer_queue);
+    clReleaseContext(context);
+}
+
+// ------------------------------------------------------------------------------------
+// Split-K / stream-K GEMM
+struct GemmSegments {
+    std::vector<int> tile;        // output tile of the segment
+    std::vector<int> begin;       // first inner-loop iteration
+    std::vector<int> end;         // last inner-loop iteration (exclusive)
+    std::vector<int> wg_first;    // segments of work-group g: [wg_first[g], wg_first[g + 1])
+    std::vector<int> tile_first;  // segments of tile t: [tile_first[t], tile_first[t + 1])
+};
+
+static void finalizeSegments(GemmSegments& segments, const size_t tiles) {
+    segments.tile_first.assign(tiles + 1, 0);
+    for (int t : segments.tile)
+        segments.tile_first[t + 1]++;
+    for (size_t t = 0; t < tiles; ++t)
+        segments.tile_first[t + 1] += segments.tile_first[t];
+}
+
+static GemmSegments scheduleSplitK(const size_t tiles, const size_t iters, const size_t splits) {
+    GemmSegments segments;
+    for (size_t t = 0; t < tiles; ++t) {
+        for (size_t s = 0; s < splits; ++s) {
+            segments.wg_first.push_back(static_cast<int>(segments.tile.size()));
+            segments.tile.push_back(static_cast<int>(t));
+            segments.begin.push_back(static_cast<int>(iters * s / splits));
+            segments.end.push_back(static_cast<int>(iters * (s + 1) / splits));
+        }
+    }
+    segments.wg_first.push_back(static_cast<int>(segments.tile.size()));
+    finalizeSegments(segments, tiles);
+    return segments;
+}
+
+static GemmSegments scheduleStreamK(const size_t tiles, const size_t iters, const size_t groups) {
+    GemmSegments segments;
+    const size_t total = tiles * iters;
+    for (size_t g = 0; g < groups; ++g) {
+        segments.wg_first.push_back(static_cast<int>(segments.tile.size()));
+        size_t first = total * g / groups;
+        const size_t last = total * (g + 1) / groups;
+        while (first < last) {
+            const size_t t = first / iters;
+            const size_t tile_end = std::min(last, (t + 1) * iters);
+            segments.tile.push_back(static_cast<int>(t));
+            segments.begin.push_back(static_cast<int>(first - t * iters));
+            segments.end.push_back(static_cast<int>(tile_end - t * iters));
+            first = tile_end;
+        }
+    }
+    segments.wg_first.push_back(static_cast<int>(segments.tile.size()));
+    finalizeSegments(segments, tiles);
+    return segments;
+}
+
+static GemmSchedule chooseGemmSchedule(const size_t tiles, const size_t iters, const size_t groups) {
+    if (tiles >= groups || iters == 1)
+        return GEMM_SCHEDULE_CLASSIC;
+    const size_t splits = (groups + tiles - 1) / tiles;
+    return (iters % splits == 0 && splits <= iters) ? GEMM_SCHEDULE_SPLIT_K : GEMM_SCHEDULE_STREAM_K;
+}
+
+void gemm_splitk_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, GemmSchedule schedule) {
+    Session session(dev_pair);
+    DeviceArray<float> a_array(session, const_cast<float*>(a), m * n);
+    DeviceArray<float> b_array(session, const_cast<float*>(b), n * k);
+    DeviceArray<float> c_array(session, c, m * k);
+
+    gemm_splitk_cl(m, n, k, a_array, b_array, c_array, session, time, schedule);
+    c_array.host();
+}
+
+void gemm_splitk_cl(const size_t m, const size_t n, const size_t k, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& c,
+    Session& session, timer& time, GemmSchedule schedule) {
+    cl_int error = CL_SUCCESS;
+    std::string build_options = "-DBLOCK=" + std::to_string(BLOCK);
+    cl_program program = session.getProgram("kernels/gemm_kernel.cl", build_options);
+
+    // A few resident work-groups per compute unit are needed to hide the memory latency
+    cl_uint compute_units = 1;
+    CONTROL("clGetDeviceInfo", clGetDeviceInfo(session.device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &compute_units, nullptr));
+    const size_t groups = 4 * static_cast<size_t>(compute_units);
+    const size_t tiles = (m / BLOCK) * (k / BLOCK);
+    const size_t iters = n / BLOCK;
+    if (schedule == GEMM_SCHEDULE_AUTO)
+        schedule = chooseGemmSchedule(tiles, iters, groups);
+
+    cl_mem a_buffer = a.read();
+    cl_mem b_buffer = b.read();
+    cl_mem c_buffer = c.write();
+
+    const unsigned int m_arg = static_cast<unsigned int>(m);
+    const unsigned int n_arg = static_cast<unsigned int>(n);
+    const unsigned int k_arg = static_cast<unsigned int>(k);
+    const size_t local[2] = { BLOCK, BLOCK };
+
+    if (schedule == GEMM_SCHEDULE_CLASSIC) {
+        std::cout << "[ INFO ] GEMM schedule: classic (" << tiles << " tiles)" << std::endl;
+        cl_kernel kernel = clCreateKernel(program, "gemm", &error);
+        CONTROL("clCreateKernel", error);
+        CONTROL("clSetKernelArg M", clSetKernelArg(kernel, 0, sizeof(unsigned int), &m_arg));
+        CONTROL("clSetKernelArg N", clSetKernelArg(kernel, 1, sizeof(unsigned int), &n_arg));
+        CONTROL("clSetKernelArg K", clSetKernelArg(kernel, 2, sizeof(unsigned int), &k_arg));
+        CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 3, sizeof(cl_mem), &a_buffer));
+        CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 4, sizeof(cl_mem), &b_buffer));
+        CONTROL("clSetKernelArg C", clSetKernelArg(kernel, 5, sizeof(cl_mem), &c_buffer));
+
+        const size_t global[2] = { k, m };
+        time.first = std::chrono::high_resolution_clock::now();
+        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 2, nullptr, global, local, 0, nullptr, nullptr));
+        CONTROL("clFinish", clFinish(session.queue));
+        time.second = std::chrono::high_resolution_clock::now();
+        clReleaseKernel(kernel);
+    }
+    else {
+        const GemmSegments segments = (schedule == GEMM_SCHEDULE_SPLIT_K)
+            ? scheduleSplitK(tiles, iters, std::min(iters, (groups + tiles - 1) / tiles))
+            : scheduleStreamK(tiles, iters, std::min(groups, tiles * iters));
+        const size_t wg_count = segments.wg_first.size() - 1;
+        std::cout << "[ INFO ] GEMM schedule: " << ((schedule == GEMM_SCHEDULE_SPLIT_K) ? "split-K" : "stream-K")
+            << " (" << tiles << " tiles, " << wg_count << " work-groups, " << segments.tile.size() << " segments)" << std::endl;
+
+        cl_kernel kernel = clCreateKernel(program, "gemm_segments", &error);
+        CONTROL("clCreateKernel", error);
+        cl_kernel reduce_kernel = clCreateKernel(program, "gemm_segments_reduce", &error);
+        CONTROL("clCreateKernel", error);
+
+        auto createIndexBuffer = [&](const std::vector<int>& data, const char* name) {
+            cl_mem buffer = clCreateBuffer(session.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int) * data.size(), const_cast<int*>(data.data()), &error);
+            CONTROL(std::string("clCreateBuffer ") + name, error);
+            return buffer;
+        };
+        cl_mem tile_buffer = createIndexBuffer(segments.tile, "Tile");
+        cl_mem begin_buffer = createIndexBuffer(segments.begin, "Begin");
+        cl_mem end_buffer = createIndexBuffer(segments.end, "End");
+        cl_mem wg_first_buffer = createIndexBuffer(segments.wg_first, "WG First");
+        cl_mem tile_first_buffer = createIndexBuffer(segments.tile_first, "Tile First");
+        cl_mem partials_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(float) * segments.tile.size() * BLOCK * BLOCK, nullptr, &error);
+        CONTROL("clCreateBuffer Partials", error);
+
+        CONTROL("clSetKernelArg M", clSetKernelArg(kernel, 0, sizeof(unsigned int), &m_arg));
+        CONTROL("clSetKernelArg N", clSetKernelArg(kernel, 1, sizeof(unsigned int), &n_arg));
+        CONTROL("clSetKernelArg K", clSetKernelArg(kernel, 2, sizeof(unsigned int), &k_arg));
+        CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 3, sizeof(cl_mem), &a_buffer));
+        CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 4, sizeof(cl_mem), &b_buffer));
+        CONTROL("clSetKernelArg Partials", clSetKernelArg(kernel, 5, sizeof(cl_mem), &partials_buffer));
+        CONTROL("clSetKernelArg Tile", clSetKernelArg(kernel, 6, sizeof(cl_mem), &tile_buffer));
+        CONTROL("clSetKernelArg Begin", clSetKernelArg(kernel, 7, sizeof(cl_mem), &begin_buffer));
+        CONTROL("clSetKernelArg End", clSetKernelArg(kernel, 8, sizeof(cl_mem), &end_buffer));
+        CONTROL("clSetKernelArg WG First", clSetKernelArg(kernel, 9, sizeof(cl_mem), &wg_first_buffer));
+
+        CONTROL("clSetKernelArg K", clSetKernelArg(reduce_kernel, 0, sizeof(unsigned int), &k_arg));
+        CONTROL("clSetKernelArg C", clSetKernelArg(reduce_kernel, 1, sizeof(cl_mem), &c_buffer));
+        CONTROL("clSetKernelArg Partials", clSetKernelArg(reduce_kernel, 2, sizeof(cl_mem), &partials_buffer));
+        CONTROL("clSetKernelArg Tile First", clSetKernelArg(reduce_kernel, 3, sizeof(cl_mem), &tile_first_buffer));
+
+        const size_t global[2] = { wg_count * BLOCK, BLOCK };
+        const size_t reduce_global[2] = { k, m };
+        time.first = std::chrono::high_resolution_clock::now();
+        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 2, nullptr, global, local, 0, nullptr, nullptr));
+        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, reduce_kernel, 2, nullptr, reduce_global, local, 0, nullptr, nullptr));
+        CONTROL("clFinish", clFinish(session.queue));
+        time.second = std::chrono::high_resolution_clock::now();
+
+        clReleaseMemObject(tile_buffer);
+        clReleaseMemObject(begin_buffer);
+        clReleaseMemObject(end_buffer);
+        clReleaseMemObject(wg_first_buffer);
+        clReleaseMemObject(tile_first_buffer);
+        clReleaseMemObject(partials_buffer);
+        clReleaseKernel(kernel);
+        clReleaseKernel(reduce_kernel);
+    }
+}
@@ -4,12 +4,79 @@
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #define MAX_ITERS 50000
 #define EPS  1e-5
+// Sweeps enqueued between two convergence checks: JACOBI_BATCH_ADAPTIVE picks the count
+// from the observed convergence rate, up to JACOBI_MAX_BATCH
+#define JACOBI_BATCH_ADAPTIVE 0
+#define JACOBI_MAX_BATCH 64
+// Rows computed by a work-group of the row-major kernel
+#define JACOBI_ROWS 4
+// Tile of the multi-right-hand-side kernel
+#define JACOBI_BLOCK 16
+// Default damping of the weighted Jacobi, power iterations and widening of the Chebyshev spectrum bounds
+#define JACOBI_OMEGA 0.8f
+#define POWER_STEPS 30
+#define SPECTRUM_MARGIN 0.1
+// Largest finite fp16 value: a matrix with a greater element isn't stored as half
+#define HALF_MAX 65504.0f
 
 #include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 #include "CL/cl.h"
 #include "utils.h"
+#include "device_array.h"
 
-void jacobi_cl(float* a, float* b, float* x0, float* x1, float* norm, int size, cl_device_type device_type,
-	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time);
+// JACOBI_KERNEL_BASIC - the original kernel on A as is.
+// JACOBI_KERNEL_ROWS / JACOBI_KERNEL_COLUMNS - the off-diagonal part and the inverse diagonal are
+// split out once, then swept by work-group-cooperative rows / by a work-item per row.
+// JACOBI_KERNEL_AUTO - columns on CPUs, rows on the other devices.
+enum JacobiKernel { JACOBI_KERNEL_BASIC, JACOBI_KERNEL_ROWS, JACOBI_KERNEL_COLUMNS, JACOBI_KERNEL_AUTO };
+
+// JACOBI_MODE_PLAIN - x1 is the Jacobi iterate. JACOBI_MODE_WEIGHTED - damped by omega:
+// x1 = x0 + omega * (x_jacobi - x0). JACOBI_MODE_CHEBYSHEV - Chebyshev semi-iterative acceleration
+// with the spectrum bounds of D^-1 A estimated by power iterations on the device.
+enum JacobiMode { JACOBI_MODE_PLAIN, JACOBI_MODE_WEIGHTED, JACOBI_MODE_CHEBYSHEV };
+
+// Every sweep: x1 = x0 + c1 * d + c2 * (x_jacobi - x0), d - the previous step
+struct JacobiAcceleration {
+    JacobiMode mode = JACOBI_MODE_PLAIN;
+    float omega = JACOBI_OMEGA;
+    float lambda_min = 0.0f;
+    float lambda_max = 0.0f;
+};
+
+// Host baseline with OpenMP threads over the rows: the same stop criterion and
+// metrics as jacobi_cl, kernel_time is the time of the sweeps. The solution is returned in x1
+int jacobi_omp(const float* a, const float* b, float* x0, float* x1, int size, timer& time, cl_ulong& kernel_time);
+void jacobi_cl(float* a, float* b, float* x0, float* x1, int size,
+	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time, const int batch = 1,
+	JacobiKernel variant = JACOBI_KERNEL_BASIC, JacobiMode mode = JACOBI_MODE_PLAIN, const float omega = JACOBI_OMEGA);
+// The same solver on device-resident arrays: the solution is returned in x1, returns the iterations
+int jacobi_cl(DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0, DeviceArray<float>& x1,
+	int size, Session& session, timer& time, cl_ulong& kernel_time, const int batch = 1,
+	JacobiKernel variant = JACOBI_KERNEL_BASIC, JacobiMode mode = JACOBI_MODE_PLAIN, const float omega = JACOBI_OMEGA);
+
+// Many right-hand sides against one matrix: b, x0 and x1 hold `rhs` vectors one after another,
+// the solution is returned in x1 and the iterations of every right-hand side in iters
+void jacobi_multi_cl(float* a, float* b, float* x0, float* x1, int size, int rhs,
+	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time, std::vector<int>& iters);
+void jacobi_multi_cl(DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0, DeviceArray<float>& x1,
+	int size, int rhs, Session& session, timer& time, cl_ulong& kernel_time, std::vector<int>& iters);
+
+// fp16 storage of A (the buffer is owned by the caller) and Jacobi reading it: 2 bytes per element
+// instead of 4, the arithmetic stays in float. createHalfMatrix returns nullptr if max|A| exceeds
+// HALF_MAX, as such elements would become inf
+cl_mem createHalfMatrix(DeviceArray<float>& a, int size, Session& session);
+int jacobi_half_cl(cl_mem a_half, DeviceArray<float>& b, DeviceArray<float>& x0, DeviceArray<float>& x1,
+	int size, Session& session, timer& time, cl_ulong& kernel_time, const int batch = 1);
+
+// Sweeps a kernel with the argument layout of `jacobi` (x0 - 2, x1 - 3, norm - 4, sweep - 7) until EPS
+// or MAX_ITERS, the other arguments are set by the caller: the solution is returned in x1.
+// With acceleration the kernel also takes d - 8, c1 - 9, c2 - 10 (see JacobiAcceleration).
+// time.first is left to the caller, so one-time preparations may be included; returns the iterations
+int jacobiSweeps(Session& session, cl_kernel kernel, size_t global_size, size_t group_size,
+	DeviceArray<float>& x0, DeviceArray<float>& x1, int size, const int batch, timer& time, cl_ulong& kernel_time,
+	const JacobiAcceleration* acceleration = nullptr);
 
 #endif // _GPU_JACOBI_H_
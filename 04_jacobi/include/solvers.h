@@ -0,0 +1,35 @@
+#ifndef _GPU_SOLVERS_H_
+#define _GPU_SOLVERS_H_
+
+#include "jacobi.h"
+
+// Relaxation factor of SOLVER_SOR (SOLVER_GAUSS_SEIDEL is omega = 1)
+#define SOR_OMEGA 1.2f
+// Work-groups of the first pass of the dot products
+#define DOT_GROUPS 64
+// Target max |b - A x| / |b| and the limit of the outer iterations of the mixed-precision solver
+#define REFINE_EPS 1e-10
+#define REFINE_MAX_ITERS 20
+
+// SOLVER_CG / SOLVER_PCG - Conjugate Gradient without / with the Jacobi (diagonal) preconditioner,
+// needs a symmetric positive definite A; stops when max |b - A x| / |b| < EPS.
+// SOLVER_GAUSS_SEIDEL / SOLVER_SOR - red-black ordering of the rows; stop, as Jacobi, on the relative change.
+enum SolverMethod { SOLVER_JACOBI, SOLVER_CG, SOLVER_PCG, SOLVER_GAUSS_SEIDEL, SOLVER_SOR };
+// Storage of A for the inner solves of the mixed-precision solver, REFINE_FP16 goes with SOLVER_JACOBI
+enum RefineStorage { REFINE_FP32, REFINE_FP16 };
+
+// The common entry point of the iterative solvers: x0 - initial guess, the solution is returned in x1.
+// The matrix stays on the device between the calls of a session; returns the count of iterations
+int solve_cl(SolverMethod method, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0,
+	DeviceArray<float>& x1, int size, Session& session, timer& time, cl_ulong& kernel_time, const float omega = SOR_OMEGA);
+int solve_cl(SolverMethod method, float* a, float* b, float* x0, float* x1, int size,
+	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time, const float omega = SOR_OMEGA);
+
+// Mixed-precision iterative refinement: the corrections A d = r are solved in float by `inner`,
+// the residuals r = b - A x and the solution x are kept in double - on the device if it supports
+// cl_khr_fp64, on the host otherwise. x holds the initial guess and returns the solution;
+// returns the count of outer iterations
+int refine_cl(SolverMethod inner, RefineStorage storage, const float* a, const double* b, double* x, int size,
+	std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time);
+
+#endif // _GPU_SOLVERS_H_
@@ -0,0 +1,69 @@
+#ifndef _GPU_SPARSE_H_
+#define _GPU_SPARSE_H_
+
+#include "jacobi.h"
+
+// Work-items per row of the CSR vector kernels and the slice parameters of SELL-C-sigma
+#define SPMV_VECTOR 8
+#define SELL_C 32
+#define SELL_SIGMA 256
+
+enum SparseFormat { SPARSE_CSR_SCALAR, SPARSE_CSR_VECTOR, SPARSE_ELL, SPARSE_SELL };
+
+// Compressed sparse rows: the nonzeros of row i are [row_ptr[i], row_ptr[i + 1])
+struct CsrMatrix {
+    int size = 0;
+    std::vector<int> row_ptr;
+    std::vector<int> col_idx;
+    std::vector<float> values;
+
+    size_t nnz() const { return values.size(); }
+};
+
+// ELLPACK: every row is padded to width entries (value 0, column 0), stored column-major
+struct EllMatrix {
+    int size = 0;
+    int width = 0;
+    std::vector<int> col_idx;
+    std::vector<float> values;
+};
+
+// SELL-C-sigma: rows are sorted by length inside windows of sigma rows and cut into slices of
+// chunk rows, each slice is a column-major ELL of its own width starting at slice_ptr[s].
+// perm maps the slots (slice * chunk + lane) to rows, -1 marks the padding of the last slice
+struct SellMatrix {
+    int size = 0;
+    int chunk = SELL_C;
+    int sigma = SELL_SIGMA;
+    std::vector<int> slice_ptr;
+    std::vector<int> perm;
+    std::vector<int> col_idx;
+    std::vector<float> values;
+};
+
+// Conversions: the dense matrix follows the repo convention (element (i, j) is a[j * size + i]),
+// zeros are dropped; duplicate COO entries are summed
+CsrMatrix csrFromDense(const float* a, int size);
+CsrMatrix csrFromCoo(int size, const std::vector<int>& rows, const std::vector<int>& cols, const std::vector<float>& values);
+EllMatrix ellFromCsr(const CsrMatrix& csr);
+SellMatrix sellFromCsr(const CsrMatrix& csr, int chunk = SELL_C, int sigma = SELL_SIGMA);
+
+// 5-point Laplacian of a grid x grid mesh shifted by `shift` on the diagonal (a discretized
+// Helmholtz-type PDE): strictly diagonally dominant for shift > 0, built through COO
+CsrMatrix generatePoissonMatrix(int grid, float shift);
+
+// SPARSE_CSR_VECTOR falls back to SPARSE_CSR_SCALAR if SPMV_VECTOR work-items don't fit a work-group
+void spmv_cl(const CsrMatrix& a, const float* x, float* y, SparseFormat format,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time);
+void spmv_cl(const CsrMatrix& a, DeviceArray<float>& x, DeviceArray<float>& y, SparseFormat format,
+    Session& session, timer& time);
+void jacobi_sparse_cl(const CsrMatrix& a, float* b, float* x0, float* x1, SparseFormat format,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time, const int batch = 1);
+// The same solver on device-resident vectors: the solution is returned in x1, returns the iterations
+int jacobi_sparse_cl(const CsrMatrix& a, DeviceArray<float>& b, DeviceArray<float>& x0, DeviceArray<float>& x1, SparseFormat format,
+    Session& session, timer& time, cl_ulong& kernel_time, const int batch = 1);
+
+// The same check as checkSolutionOfSOLE with the residual computed on the CSR matrix
+void checkSolutionOfSparseSOLE(const CsrMatrix& a, const float* b, const float* x, const float eps);
+
+#endif // _GPU_SPARSE_H_
@@ -1,14 +1,222 @@
-__kernel void jacobi(__global float *A, __global float *b, __global float *x0, 
-                     __global float *x1, __global float *norm, unsigned int size) {
+#ifndef JACOBI_ROWS
+#define JACOBI_ROWS 4
+#endif
+
+#include "reduce.cl"
+
+// Accelerated update of a component: x1 = x0 + c1 * d + c2 * (x_jacobi - x0), d - the previous step.
+// Plain Jacobi is (c1, c2) = (0, 1), weighted Jacobi (0, omega), Chebyshev changes them every sweep.
+// Returns the relative change |x1 - x0| / |x0|
+float accelerate(float x_jacobi, unsigned int row, __global const float *x0, __global float *x1,
+                 __global float *d, float c1, float c2) {
+    const float step = c1 * d[row] + c2 * (x_jacobi - x0[row]);
+    d[row] = step;
+    x1[row] = x0[row] + step;
+    return fabs(step / x0[row]);
+}
+
+// norm[sweep] - max |x1 - x0| / |x0| over all the components.
+// A batch of sweeps writes one slot per sweep, so the host checks all of them with a single read.
+__kernel void jacobi(__global float *A, __global float *b, __global float *x0,
+                     __global float *x1, __global int *norm, unsigned int size, __local float *scratch,
+                     unsigned int sweep, __global float *d, float c1, float c2) {
+    const unsigned int ithr = get_global_id(0);
+
+    float change = .0f;
+    if (ithr < size) {
+        float sum = .0f;
+        for (unsigned int j = 0; j < size; j++) {
+            sum += A[j * size + ithr] * x0[j] * (float)(ithr != j);
+        }
+
+        change = accelerate((b[ithr] - sum) / A[ithr * size + ithr], ithr, x0, x1, d, c1, c2);
+    }
+
+    reduce_change(change, scratch, norm, sweep);
+}
+
+// w = shift * v + sign * D^-1 A v: the operator of the power iterations bounding the spectrum of D^-1 A
+__kernel void jacobi_operator(__global const float *A, __global const float *v, __global float *w,
+                              unsigned int size, float shift, float sign) {
+    const unsigned int i = get_global_id(0);
+    if (i < size) {
+        float sum = .0f;
+        for (unsigned int j = 0; j < size; j++)
+            sum += A[j * size + i] * v[j];
+        w[i] = shift * v[i] + sign * sum / A[i * size + i];
+    }
+}
+
+// fp16 storage of A for the mixed-precision solver: A is read as half and computed in float
+__kernel void to_half(__global const float *A, __global half *A_half, unsigned int count) {
+    const unsigned int i = get_global_id(0);
+    if (i < count)
+        vstore_half(A[i], i, A_half);
+}
+
+__kernel void jacobi_half(__global const half *A, __global float *b, __global float *x0,
+                          __global float *x1, __global int *norm, unsigned int size, __local float *scratch,
+                          unsigned int sweep) {
     const unsigned int ithr = get_global_id(0);
-    if (ithr >= size)
-        return;
+
+    float change = .0f;
+    if (ithr < size) {
+        float sum = .0f;
+        for (unsigned int j = 0; j < size; j++) {
+            sum += vload_half(j * size + ithr, A) * x0[j];
+        }
+        const float diag = vload_half(ithr * size + ithr, A);
+        sum -= diag * x0[ithr];
+
+        x1[ithr] = (b[ithr] - sum) / diag;
+        change = fabs((x1[ithr] - x0[ithr]) / x0[ithr]);
+    }
+
+    reduce_change(change, scratch, norm, sweep);
+}
+
+// One-time split of A (element (i, j) is A[j * size + i]) into the off-diagonal part R and
+// the inverse diagonal. Row-major R is padded with zeros up to the leading dimension ld.
+// Global range: (ld, size) for row-major, (size, size) for column-major.
+__kernel void jacobi_prepare(__global const float *A, __global float *R, __global float *inv_diag,
+                             unsigned int size, unsigned int ld, int row_major) {
+    const unsigned int j = get_global_id(0);
+    const unsigned int i = get_global_id(1);
+
+    const float value = (i != j && j < size) ? A[j * size + i] : .0f;
+    if (row_major)
+        R[i * ld + j] = value;
+    else
+        R[j * ld + i] = value;
+    if (i == j)
+        inv_diag[i] = 1.0f / A[i * size + i];
+}
+
+// Column-major R: a work-item per row, neighbouring work-items read neighbouring elements
+// of every column (coalesced on GPUs, vectorized across work-items on CPUs).
+__kernel void jacobi_columns(__global const float *R, __global const float *b, __global const float *x0,
+                             __global float *x1, __global int *norm, unsigned int size, __local float *scratch,
+                             unsigned int sweep, __global float *d, float c1, float c2,
+                             __global const float *inv_diag, unsigned int ld) {
+    const unsigned int ithr = get_global_id(0);
+
+    float change = .0f;
+    if (ithr < size) {
+        float sum = .0f;
+        for (unsigned int j = 0; j < size; j++) {
+            sum += R[j * ld + ithr] * x0[j];
+        }
+
+        change = accelerate((b[ithr] - sum) * inv_diag[ithr], ithr, x0, x1, d, c1, c2);
+    }
+
+    reduce_change(change, scratch, norm, sweep);
+}
+
+// Row-major R: a work-group computes JACOBI_ROWS rows. Work-items stride over the columns with
+// float4 loads, the float4 of x0 a work-item loads is kept in registers and reused for all
+// the rows of the group, the partial sums are reduced in local memory.
+// ld is a multiple of 4 * get_local_size(0), so the rows need no bounds checks.
+// scratch - JACOBI_ROWS * get_local_size(0) floats.
+__kernel void jacobi_rows(__global const float *R, __global const float *b, __global const float *x0,
+                          __global float *x1, __global int *norm, unsigned int size, __local float *scratch,
+                          unsigned int sweep, __global float *d, float c1, float c2,
+                          __global const float *inv_diag, unsigned int ld) {
+    const unsigned int lid = get_local_id(0);
+    const unsigned int lsize = get_local_size(0);
+    const unsigned int first_row = get_group_id(0) * JACOBI_ROWS;
+
+    float acc[JACOBI_ROWS];
+    for (unsigned int r = 0; r < JACOBI_ROWS; r++)
+        acc[r] = .0f;
+
+    for (unsigned int col = 4 * lid; col < ld; col += 4 * lsize) {
+        float4 x;
+        if (col + 3 < size) {
+            x = vload4(0, x0 + col);
+        } else {
+            x.s0 = (col < size) ? x0[col] : .0f;
+            x.s1 = (col + 1 < size) ? x0[col + 1] : .0f;
+            x.s2 = (col + 2 < size) ? x0[col + 2] : .0f;
+            x.s3 = .0f;
+        }
+        for (unsigned int r = 0; r < JACOBI_ROWS; r++) {
+            const unsigned int row = min(first_row + r, size - 1);
+            acc[r] += dot(vload4(0, R + row * ld + col), x);
+        }
+    }
+
+    for (unsigned int r = 0; r < JACOBI_ROWS; r++)
+        scratch[r * lsize + lid] = acc[r];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = lsize / 2; s > 0; s >>= 1) {
+        if (lid < s) {
+            for (unsigned int r = 0; r < JACOBI_ROWS; r++)
+                scratch[r * lsize + lid] += scratch[r * lsize + lid + s];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    float change = .0f;
+    const unsigned int row = first_row + lid;
+    if (lid < JACOBI_ROWS && row < size) {
+        change = accelerate((b[row] - scratch[lid * lsize]) * inv_diag[row], row, x0, x1, d, c1, c2);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    reduce_change(change, scratch, norm, sweep);
+}
+
+#ifndef BLOCK
+#define BLOCK 16
+#endif
+
+// Jacobi sweep of many right-hand sides at once: B, X0 and X1 hold the vectors one after another
+// (column `col` of the block starts at col * size), so a sweep is the product A * X0 tiled as GEMM
+// and every tile of A is read once for BLOCK columns.
+// cols - indices of the columns which have not converged yet (`active` of them), the converged ones
+// are left out of the NDRange. norms[col] - max relative change of the column, as int bits.
+// Local size: (BLOCK, BLOCK), dim 0 - rows, dim 1 - active columns.
+__kernel void jacobi_multi(__global const float *A, __global const float *B, __global const float *X0,
+                           __global float *X1, __global int *norms, unsigned int size,
+                           __global const int *cols, unsigned int active) {
+    const unsigned int li = get_local_id(0);
+    const unsigned int lk = get_local_id(1);
+    const unsigned int i = get_global_id(0);
+    const unsigned int slot = get_global_id(1);
+    const int col = (slot < active) ? cols[slot] : -1;
+
+    __local float a_tile[BLOCK][BLOCK];
+    __local float x_tile[BLOCK][BLOCK];
+    __local float change_tile[BLOCK][BLOCK];
 
     float sum = .0f;
-    for (unsigned int j = 0; j < size; j++) {
-        sum += A[j * size + ithr] * x0[j] * (float)(ithr != j);
+    for (unsigned int j0 = 0; j0 < size; j0 += BLOCK) {
+        // a_tile[jj][ii] = A(i0 + ii, j0 + jj), x_tile[kk][jj] = X0(j0 + jj) of the column kk
+        a_tile[lk][li] = (i < size && j0 + lk < size) ? A[(j0 + lk) * size + i] : .0f;
+        x_tile[lk][li] = (col >= 0 && j0 + li < size) ? X0[col * size + j0 + li] : .0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (unsigned int jj = 0; jj < BLOCK; jj++)
+            sum += a_tile[jj][li] * x_tile[lk][jj];
+        barrier(CLK_LOCAL_MEM_FENCE);
     }
 
-    x1[ithr] = (b[ithr] - sum) / A[ithr * size + ithr];
-    norm[ithr] = x1[ithr] - x0[ithr];
+    float change = .0f;
+    if (col >= 0 && i < size) {
+        const float diag = A[i * size + i];
+        const float x_old = X0[col * size + i];
+        const float x = (B[col * size + i] - (sum - diag * x_old)) / diag;
+        X1[col * size + i] = x;
+        change = fabs((x - x_old) / x_old);
+    }
+
+    change_tile[lk][li] = change;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = BLOCK / 2; s > 0; s >>= 1) {
+        if (li < s)
+            change_tile[lk][li] = fmax(change_tile[lk][li], change_tile[lk][li + s]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (li == 0 && col >= 0)
+        atomic_max(norms + col, as_int(change_tile[lk][0]));
 }
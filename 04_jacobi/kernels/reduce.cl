@@ -0,0 +1,18 @@
+// Shared by the kernels of 04_jacobi through #include "reduce.cl": the sources are expanded the same
+// way at runtime (createProgramFromSource) and at build time (embed_kernels.py)
+
+// Max-reduction of the relative change over the work-group, folded into norm[sweep] as int bits:
+// non-negative floats are ordered the same way as their bit patterns, so atomic_max works on them.
+// scratch - local buffer of get_local_size(0) floats, the local size is a power of 2.
+void reduce_change(float change, __local float *scratch, __global int *norm, unsigned int sweep) {
+    const unsigned int lid = get_local_id(0);
+    scratch[lid] = change;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            scratch[lid] = fmax(scratch[lid], scratch[lid + s]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0)
+        atomic_max(norm + sweep, as_int(scratch[0]));
+}
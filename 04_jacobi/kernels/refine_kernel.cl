@@ -0,0 +1,40 @@
+// Outer loop of the mixed-precision solver in double: built only on devices with cl_khr_fp64.
+// The matrix is the float one of `jacobi`, element (i, j) is A[j * size + i].
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+// r = b - A * x accumulated in double. The inner solve gets r rounded to float as its right-hand side
+// and r / diag as its initial guess; norm - max |r / b| as int bits of a float (see jacobi_kernel.cl)
+__kernel void residual_fp64(__global const float *A, __global const double *b, __global const double *x,
+                            __global float *r, __global float *guess, __global int *norm, unsigned int size,
+                            __local float *scratch) {
+    const unsigned int i = get_global_id(0);
+    const unsigned int lid = get_local_id(0);
+
+    float value = .0f;
+    if (i < size) {
+        double sum = .0;
+        for (unsigned int j = 0; j < size; j++)
+            sum += (double)A[j * size + i] * x[j];
+        const double res = b[i] - sum;
+        r[i] = (float)res;
+        guess[i] = (float)(res / A[i * size + i]);
+        value = (float)fabs(res / b[i]);
+    }
+
+    scratch[lid] = value;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            scratch[lid] = fmax(scratch[lid], scratch[lid + s]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0)
+        atomic_max(norm, as_int(scratch[0]));
+}
+
+// x += d, the correction of the inner solve
+__kernel void update_fp64(__global double *x, __global const float *d, unsigned int size) {
+    const unsigned int i = get_global_id(0);
+    if (i < size)
+        x[i] += d[i];
+}
@@ -0,0 +1,132 @@
+// Dense kernels of the Krylov and Gauss-Seidel solvers: the matrix is the one of `jacobi`,
+// element (i, j) is A[j * size + i].
+
+#include "reduce.cl"
+
+float sum_reduce(float value, __local float *scratch) {
+    const unsigned int lid = get_local_id(0);
+    scratch[lid] = value;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            scratch[lid] += scratch[lid + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    return scratch[0];
+}
+
+// y = A * x
+__kernel void matvec(__global const float *A, __global const float *x, __global float *y, unsigned int size) {
+    const unsigned int i = get_global_id(0);
+    if (i < size) {
+        float sum = .0f;
+        for (unsigned int j = 0; j < size; j++)
+            sum += A[j * size + i] * x[j];
+        y[i] = sum;
+    }
+}
+
+// r = b - A * x
+__kernel void residual(__global const float *A, __global const float *b, __global const float *x,
+                       __global float *r, unsigned int size) {
+    const unsigned int i = get_global_id(0);
+    if (i < size) {
+        float sum = .0f;
+        for (unsigned int j = 0; j < size; j++)
+            sum += A[j * size + i] * x[j];
+        r[i] = b[i] - sum;
+    }
+}
+
+__kernel void inverse_diagonal(__global const float *A, __global float *inv_diag, unsigned int size) {
+    const unsigned int i = get_global_id(0);
+    if (i < size)
+        inv_diag[i] = 1.0f / A[i * size + i];
+}
+
+// z = inv_diag * r
+__kernel void precondition(__global const float *r, __global const float *inv_diag, __global float *z, unsigned int size) {
+    const unsigned int i = get_global_id(0);
+    if (i < size)
+        z[i] = r[i] * inv_diag[i];
+}
+
+// Two-pass dot product: a fixed number of work-groups strides over the vectors and writes
+// its partial sum, dot_finalize (a single work-group) sums the partials into scalars[slot],
+// so the scalars of the iteration never leave the device
+__kernel void dot_partial(__global const float *x, __global const float *y, __global float *partials,
+                          unsigned int size, __local float *scratch) {
+    float sum = .0f;
+    for (unsigned int i = get_global_id(0); i < size; i += get_global_size(0))
+        sum += x[i] * y[i];
+    sum = sum_reduce(sum, scratch);
+    if (get_local_id(0) == 0)
+        partials[get_group_id(0)] = sum;
+}
+
+__kernel void dot_finalize(__global const float *partials, unsigned int groups, __global float *scalars,
+                           unsigned int slot, __local float *scratch) {
+    float sum = .0f;
+    for (unsigned int i = get_local_id(0); i < groups; i += get_local_size(0))
+        sum += partials[i];
+    sum = sum_reduce(sum, scratch);
+    if (get_local_id(0) == 0)
+        scalars[slot] = sum;
+}
+
+// alpha = (r, z) / (p, A p): x += alpha * p, r -= alpha * A p
+__kernel void cg_step(__global float *x, __global float *r, __global const float *p, __global const float *q,
+                      __global const float *scalars, unsigned int rz_slot, unsigned int pq_slot, unsigned int size) {
+    const unsigned int i = get_global_id(0);
+    if (i < size) {
+        const float alpha = scalars[rz_slot] / scalars[pq_slot];
+        x[i] += alpha * p[i];
+        r[i] -= alpha * q[i];
+    }
+}
+
+// beta = (r, z)_new / (r, z)_old: p = z + beta * p
+__kernel void cg_direction(__global const float *z, __global float *p, __global const float *scalars,
+                           unsigned int rz_new_slot, unsigned int rz_old_slot, unsigned int size) {
+    const unsigned int i = get_global_id(0);
+    if (i < size) {
+        const float beta = scalars[rz_new_slot] / scalars[rz_old_slot];
+        p[i] = z[i] + beta * p[i];
+    }
+}
+
+// norm[0] = max |r / b|, the measure of checkSolutionOfSOLE
+__kernel void relative_residual(__global const float *r, __global const float *b, __global int *norm,
+                                unsigned int size, __local float *scratch) {
+    const unsigned int i = get_global_id(0);
+    float value = .0f;
+    if (i < size)
+        value = fabs(r[i] / b[i]);
+    reduce_change(value, scratch, norm, 0);
+}
+
+// A half-sweep of red-black SOR: the rows of `color` (row % 2) are relaxed from x_src,
+// the other rows are carried over, so the second color already sees the new values of the first.
+// norm[0] - max relative change of the relaxed rows
+__kernel void sor_color(__global const float *A, __global const float *b, __global const float *x_src,
+                        __global float *x_dst, __global int *norm, unsigned int size, __local float *scratch,
+                        unsigned int color, float omega) {
+    const unsigned int i = get_global_id(0);
+    float change = .0f;
+    if (i < size) {
+        if (i % 2 == color) {
+            float sum = .0f;
+            for (unsigned int j = 0; j < size; j++)
+                sum += A[j * size + i] * x_src[j];
+            const float diag = A[i * size + i];
+            sum -= diag * x_src[i];
+
+            const float x = (1.0f - omega) * x_src[i] + omega * (b[i] - sum) / diag;
+            x_dst[i] = x;
+            change = fabs((x - x_src[i]) / x_src[i]);
+        } else {
+            x_dst[i] = x_src[i];
+        }
+    }
+    reduce_change(change, scratch, norm, 0);
+}
@@ -0,0 +1,162 @@
+#ifndef SPMV_VECTOR
+#define SPMV_VECTOR 8
+#endif
+
+// Layouts (see sparse.h):
+// CSR      - row_ptr[size + 1], col_idx / values[nnz].
+// ELL      - width entries per row stored column-major: entry k of row i is at k * size + i,
+//            the padding has value 0 and column 0.
+// SELL-C-s - rows sorted by length inside windows of sigma rows and cut into slices of C rows,
+//            every slice is an ELL of its own width: entry k of lane l is at slice_ptr[s] + k * C + l,
+//            perm maps the slots to rows (-1 for the padding of the last slice).
+
+float csr_row(__global const int *row_ptr, __global const int *col_idx, __global const float *values,
+              __global const float *x, unsigned int row) {
+    float sum = .0f;
+    for (int k = row_ptr[row]; k < row_ptr[row + 1]; k++)
+        sum += values[k] * x[col_idx[k]];
+    return sum;
+}
+
+float ell_row(__global const int *col_idx, __global const float *values, unsigned int width,
+              __global const float *x, unsigned int row, unsigned int size) {
+    float sum = .0f;
+    for (unsigned int k = 0; k < width; k++)
+        sum += values[k * size + row] * x[col_idx[k * size + row]];
+    return sum;
+}
+
+float sell_row(__global const int *slice_ptr, __global const int *col_idx, __global const float *values,
+               __global const float *x, unsigned int slot, unsigned int chunk) {
+    const unsigned int slice = slot / chunk;
+    const unsigned int lane = slot % chunk;
+    float sum = .0f;
+    for (int k = slice_ptr[slice] + lane; k < slice_ptr[slice + 1]; k += chunk)
+        sum += values[k] * x[col_idx[k]];
+    return sum;
+}
+
+#include "reduce.cl"
+
+// A Jacobi sweep on the whole row (diagonal included): x1 = x0 + (b - A * x0) / diag
+float jacobi_update(float ax, __global const float *b, __global const float *inv_diag,
+                    __global const float *x0, __global float *x1, unsigned int row) {
+    const float x = x0[row] + (b[row] - ax) * inv_diag[row];
+    x1[row] = x;
+    return fabs((x - x0[row]) / x0[row]);
+}
+
+// ------------------------------------------------------------------------------------
+// SpMV: y = A * x
+
+__kernel void spmv_csr_scalar(__global const int *row_ptr, __global const int *col_idx, __global const float *values,
+                              __global const float *x, __global float *y, unsigned int size) {
+    const unsigned int row = get_global_id(0);
+    if (row < size)
+        y[row] = csr_row(row_ptr, col_idx, values, x, row);
+}
+
+// SPMV_VECTOR work-items per row stride over its nonzeros, the partial sums are reduced in local memory.
+// partial - get_local_size(0) floats
+__kernel void spmv_csr_vector(__global const int *row_ptr, __global const int *col_idx, __global const float *values,
+                              __global const float *x, __global float *y, unsigned int size, __local float *partial) {
+    const unsigned int lid = get_local_id(0);
+    const unsigned int lane = lid % SPMV_VECTOR;
+    const unsigned int row = get_global_id(0) / SPMV_VECTOR;
+
+    float sum = .0f;
+    if (row < size) {
+        for (int k = row_ptr[row] + lane; k < row_ptr[row + 1]; k += SPMV_VECTOR)
+            sum += values[k] * x[col_idx[k]];
+    }
+    partial[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = SPMV_VECTOR / 2; s > 0; s >>= 1) {
+        if (lane < s)
+            partial[lid] += partial[lid + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lane == 0 && row < size)
+        y[row] = partial[lid];
+}
+
+__kernel void spmv_ell(__global const int *col_idx, __global const float *values, unsigned int width,
+                       __global const float *x, __global float *y, unsigned int size) {
+    const unsigned int row = get_global_id(0);
+    if (row < size)
+        y[row] = ell_row(col_idx, values, width, x, row, size);
+}
+
+__kernel void spmv_sell(__global const int *slice_ptr, __global const int *col_idx, __global const float *values,
+                        __global const int *perm, unsigned int chunk,
+                        __global const float *x, __global float *y, unsigned int slots) {
+    const unsigned int slot = get_global_id(0);
+    if (slot < slots && perm[slot] >= 0)
+        y[perm[slot]] = sell_row(slice_ptr, col_idx, values, x, slot, chunk);
+}
+
+// ------------------------------------------------------------------------------------
+// Jacobi sweeps with the argument layout of `jacobi`:
+// (values, b, x0, x1, norm, size, scratch, sweep, inv_diag, col_idx, format arguments...)
+
+__kernel void jacobi_csr_scalar(__global const float *values, __global const float *b, __global const float *x0,
+                                __global float *x1, __global int *norm, unsigned int size, __local float *scratch,
+                                unsigned int sweep, __global const float *inv_diag, __global const int *col_idx,
+                                __global const int *row_ptr) {
+    const unsigned int row = get_global_id(0);
+    float change = .0f;
+    if (row < size)
+        change = jacobi_update(csr_row(row_ptr, col_idx, values, x0, row), b, inv_diag, x0, x1, row);
+    reduce_change(change, scratch, norm, sweep);
+}
+
+__kernel void jacobi_csr_vector(__global const float *values, __global const float *b, __global const float *x0,
+                                __global float *x1, __global int *norm, unsigned int size, __local float *scratch,
+                                unsigned int sweep, __global const float *inv_diag, __global const int *col_idx,
+                                __global const int *row_ptr) {
+    const unsigned int lid = get_local_id(0);
+    const unsigned int lane = lid % SPMV_VECTOR;
+    const unsigned int row = get_global_id(0) / SPMV_VECTOR;
+
+    float sum = .0f;
+    if (row < size) {
+        for (int k = row_ptr[row] + lane; k < row_ptr[row + 1]; k += SPMV_VECTOR)
+            sum += values[k] * x0[col_idx[k]];
+    }
+    scratch[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = SPMV_VECTOR / 2; s > 0; s >>= 1) {
+        if (lane < s)
+            scratch[lid] += scratch[lid + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    float change = .0f;
+    if (lane == 0 && row < size)
+        change = jacobi_update(scratch[lid], b, inv_diag, x0, x1, row);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    reduce_change(change, scratch, norm, sweep);
+}
+
+__kernel void jacobi_ell(__global const float *values, __global const float *b, __global const float *x0,
+                         __global float *x1, __global int *norm, unsigned int size, __local float *scratch,
+                         unsigned int sweep, __global const float *inv_diag, __global const int *col_idx,
+                         unsigned int width) {
+    const unsigned int row = get_global_id(0);
+    float change = .0f;
+    if (row < size)
+        change = jacobi_update(ell_row(col_idx, values, width, x0, row, size), b, inv_diag, x0, x1, row);
+    reduce_change(change, scratch, norm, sweep);
+}
+
+__kernel void jacobi_sell(__global const float *values, __global const float *b, __global const float *x0,
+                          __global float *x1, __global int *norm, unsigned int size, __local float *scratch,
+                          unsigned int sweep, __global const float *inv_diag, __global const int *col_idx,
+                          __global const int *slice_ptr, __global const int *perm, unsigned int chunk,
+                          unsigned int slots) {
+    const unsigned int slot = get_global_id(0);
+    float change = .0f;
+    if (slot < slots && perm[slot] >= 0)
+        change = jacobi_update(sell_row(slice_ptr, col_idx, values, x0, slot, chunk), b, inv_diag, x0, x1, perm[slot]);
+    reduce_change(change, scratch, norm, sweep);
+}
@@ -4,11 +4,15 @@
 #include <vector>
 
 #include "include/jacobi.h"
+#include "include/sparse.h"
+#include "include/solvers.h"
 #include "exceptions.h"
 #include "utils.h"
 
 #define FLAG_CHECK true
 #define SIZE 2048
+#define SPARSE_GRID 512
+#define RHS 64
 
 int main(int argc, char** argv) {
     std::vector<cl_platform_id> platforms;
@@ -35,7 +39,6 @@ int main(int argc, char** argv) {
     float* b = new float[SIZE];
     float* x0 = new float[SIZE];
     float* x1 = new float[SIZE];
-    float* norm = new float[SIZE];
     float* tmp = new float[SIZE];
     cl_ulong kernel_time = 0;
     timer time;
@@ -53,14 +56,13 @@ int main(int argc, char** argv) {
             << "===========================" << std::endl;
         for (size_t i = 0; i < gpus.size(); i++) {
             std::memcpy(x0, tmp, SIZE * sizeof(float));
-            std::memset(norm, 0, sizeof(float) * SIZE);
             std::memset(x1, 0, sizeof(float) * SIZE);
 
             char name[128];
             clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
             std::cout << "Time 'GPU' (device " << name << ")" << std::endl;
 
-            jacobi_cl(a, b, x0, x1, norm, SIZE, CL_DEVICE_TYPE_GPU, gpus[i], time, kernel_time);
+            jacobi_cl(a, b, x0, x1, SIZE, gpus[i], time, kernel_time);
 
             std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
                 "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
@@ -79,14 +81,13 @@ int main(int argc, char** argv) {
             << "===========================" << std::endl;
         for (size_t i = 0; i < cpus.size(); i++) {
             std::memcpy(x0, tmp, SIZE * sizeof(float));
-            std::memset(norm, 0, sizeof(float) * SIZE);
             std::memset(x1, 0, sizeof(float) * SIZE);
 
             char name[128];
             clGetDeviceInfo(cpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
             std::cout << "Time 'CPU' (device " << name << ")" << std::endl;
 
-            jacobi_cl(a, b, x0, x1, norm, SIZE, CL_DEVICE_TYPE_CPU, cpus[i], time, kernel_time);
+            jacobi_cl(a, b, x0, x1, SIZE, cpus[i], time, kernel_time);
 
             std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
                 "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
@@ -98,11 +99,300 @@ int main(int argc, char** argv) {
         std::cout << exception.what() << std::endl;
     }
 
+    // HOST OPENMP
+    {
+        std::cout << "===========================" << std::endl
+            << "\tHOST OPENMP" << std::endl
+            << "===========================" << std::endl;
+        std::memcpy(x0, tmp, SIZE * sizeof(float));
+        std::memset(x1, 0, sizeof(float) * SIZE);
+
+        std::cout << "Time 'OMP'" << std::endl;
+        jacobi_omp(a, b, x0, x1, SIZE, time, kernel_time);
+
+        std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+            "-- only sweeps: " << kernel_time * 1e-06 << " ms" << std::endl;
+        if (FLAG_CHECK)
+            checkSolutionOfSOLE(SIZE, a, b, x1, EPS);
+        std::cout << std::endl;
+    }
+
+    // GPU OPENCL, DEVICE-RESIDENT MATRIX
+    try {
+        std::cout << "===========================" << std::endl
+            << "\tGPU OPENCL (SESSION)" << std::endl
+            << "===========================" << std::endl;
+        for (size_t i = 0; i < gpus.size(); i++) {
+            // A is uploaded once and stays on the device for all the solves of the session
+            Session session(gpus[i]);
+            DeviceArray<float> a_array(session, a, SIZE * SIZE);
+            DeviceArray<float> b_array(session, b, SIZE);
+            DeviceArray<float> x0_array(session, x0, SIZE);
+            DeviceArray<float> x1_array(session, x1, SIZE);
+
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (int rhs = 0; rhs < 2; rhs++) {
+                generateVector(b_array.host(), SIZE);
+                b_array.hostModified();
+                std::memcpy(x0_array.host(), tmp, SIZE * sizeof(float));
+                x0_array.hostModified();
+
+                std::cout << "Time 'GPU' (device " << name << "), right-hand side " << rhs << std::endl;
+                jacobi_cl(a_array, b_array, x0_array, x1_array, SIZE, session, time, kernel_time);
+
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1_array.host(), EPS);
+                std::cout << std::endl;
+            }
+        }
+    } catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    // GPU OPENCL, BATCHED SWEEPS
+    try {
+        std::cout << "===========================" << std::endl
+            << "\tGPU OPENCL (BATCHED SWEEPS)" << std::endl
+            << "===========================" << std::endl;
+        const std::vector<int> batches = { 16, JACOBI_BATCH_ADAPTIVE };
+        for (size_t i = 0; i < gpus.size(); i++) {
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (const int batch : batches) {
+                std::memcpy(x0, tmp, SIZE * sizeof(float));
+                std::memset(x1, 0, sizeof(float) * SIZE);
+
+                std::cout << "Time 'GPU' (device " << name << "), batch " <<
+                    (batch == JACOBI_BATCH_ADAPTIVE ? std::string("adaptive") : std::to_string(batch)) << std::endl;
+                jacobi_cl(a, b, x0, x1, SIZE, gpus[i], time, kernel_time, batch);
+
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1, EPS);
+                std::cout << std::endl;
+            }
+        }
+    } catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    // KERNEL VARIANTS
+    try {
+        std::cout << "===========================" << std::endl
+            << "\tKERNEL VARIANTS" << std::endl
+            << "===========================" << std::endl;
+        std::vector<std::pair<cl_platform_id, cl_device_id>> devices(gpus);
+        devices.insert(devices.end(), cpus.begin(), cpus.end());
+        const std::vector<std::pair<JacobiKernel, std::string>> variants = {
+            { JACOBI_KERNEL_BASIC, "basic" }, { JACOBI_KERNEL_ROWS, "rows" },
+            { JACOBI_KERNEL_COLUMNS, "columns" }, { JACOBI_KERNEL_AUTO, "auto" } };
+        for (size_t i = 0; i < devices.size(); i++) {
+            char name[128];
+            clGetDeviceInfo(devices[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (const auto& variant : variants) {
+                std::memcpy(x0, tmp, SIZE * sizeof(float));
+                std::memset(x1, 0, sizeof(float) * SIZE);
+
+                std::cout << "Time (device " << name << "), kernel " << variant.second << std::endl;
+                jacobi_cl(a, b, x0, x1, SIZE, devices[i], time, kernel_time, JACOBI_BATCH_ADAPTIVE, variant.first);
+
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1, EPS);
+                std::cout << std::endl;
+            }
+        }
+    } catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    // ACCELERATION
+    try {
+        std::cout << "===========================" << std::endl
+            << "\tWEIGHTED / CHEBYSHEV JACOBI" << std::endl
+            << "===========================" << std::endl;
+        const std::vector<std::pair<JacobiMode, std::string>> modes = {
+            { JACOBI_MODE_PLAIN, "plain" }, { JACOBI_MODE_WEIGHTED, "weighted" }, { JACOBI_MODE_CHEBYSHEV, "Chebyshev" } };
+        for (size_t i = 0; i < gpus.size(); i++) {
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (const auto& mode : modes) {
+                std::memcpy(x0, tmp, SIZE * sizeof(float));
+                std::memset(x1, 0, sizeof(float) * SIZE);
+
+                std::cout << "Time 'GPU' (device " << name << "), " << mode.second << std::endl;
+                jacobi_cl(a, b, x0, x1, SIZE, gpus[i], time, kernel_time, 1, JACOBI_KERNEL_BASIC, mode.first);
+
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1, EPS);
+                std::cout << std::endl;
+            }
+        }
+    } catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    // SPARSE
+    try {
+        std::cout << "===========================" << std::endl
+            << "\tSPARSE (CSR / ELL / SELL-C-SIGMA)" << std::endl
+            << "===========================" << std::endl;
+        // The dense system goes through the CSR conversion as is
+        const CsrMatrix dense_csr = csrFromDense(a, SIZE);
+        // A 5-point stencil: SPARSE_GRID^2 unknowns, ~5 nonzeros per row
+        const CsrMatrix poisson = generatePoissonMatrix(SPARSE_GRID, 1.0f);
+        const int n = poisson.size;
+        std::vector<float> sparse_b(n), sparse_x0(n), sparse_x1(n), sparse_y(n);
+        generateVector(sparse_b.data(), n);
+        std::cout << "Poisson system: " << n << " unknowns, " << poisson.nnz() << " nonzeros" << std::endl << std::endl;
+
+        std::vector<std::pair<cl_platform_id, cl_device_id>> devices(gpus);
+        devices.insert(devices.end(), cpus.begin(), cpus.end());
+        const std::vector<std::pair<SparseFormat, std::string>> formats = {
+            { SPARSE_CSR_SCALAR, "CSR scalar" }, { SPARSE_CSR_VECTOR, "CSR vector" },
+            { SPARSE_ELL, "ELL" }, { SPARSE_SELL, "SELL-C-sigma" } };
+        for (size_t i = 0; i < devices.size(); i++) {
+            char name[128];
+            clGetDeviceInfo(devices[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (const auto& format : formats) {
+                std::cout << "Time (device " << name << "), " << format.second << std::endl;
+
+                spmv_cl(poisson, sparse_b.data(), sparse_y.data(), format.first, devices[i], time);
+                std::cout << "-- SpMV: " << TIME_US(time.first, time.second) << std::endl;
+
+                std::memcpy(x0, tmp, SIZE * sizeof(float));
+                std::memset(x1, 0, sizeof(float) * SIZE);
+                jacobi_sparse_cl(dense_csr, b, x0, x1, format.first, devices[i], time, kernel_time, JACOBI_BATCH_ADAPTIVE);
+                std::cout << "-- dense system, all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- dense system, only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1, EPS);
+
+                std::fill(sparse_x0.begin(), sparse_x0.end(), 1.0f);
+                std::fill(sparse_x1.begin(), sparse_x1.end(), 0.0f);
+                jacobi_sparse_cl(poisson, sparse_b.data(), sparse_x0.data(), sparse_x1.data(), format.first,
+                    devices[i], time, kernel_time, JACOBI_BATCH_ADAPTIVE);
+                std::cout << "-- Poisson system, all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- Poisson system, only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSparseSOLE(poisson, sparse_b.data(), sparse_x1.data(), EPS);
+                std::cout << std::endl;
+            }
+        }
+    } catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    // SOLVERS
+    try {
+        std::cout << "===========================" << std::endl
+            << "\tSOLVERS (GPU OPENCL)" << std::endl
+            << "===========================" << std::endl;
+        const std::vector<std::pair<SolverMethod, std::string>> methods = {
+            { SOLVER_JACOBI, "Jacobi" }, { SOLVER_CG, "CG" }, { SOLVER_PCG, "CG + Jacobi preconditioner" },
+            { SOLVER_GAUSS_SEIDEL, "red-black Gauss-Seidel" }, { SOLVER_SOR, "red-black SOR" } };
+        for (size_t i = 0; i < gpus.size(); i++) {
+            // All the solvers share the matrix uploaded once
+            Session session(gpus[i]);
+            DeviceArray<float> a_array(session, a, SIZE * SIZE);
+            DeviceArray<float> b_array(session, b, SIZE);
+            DeviceArray<float> x0_array(session, x0, SIZE);
+            DeviceArray<float> x1_array(session, x1, SIZE);
+
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (const auto& method : methods) {
+                std::memcpy(x0_array.host(), tmp, SIZE * sizeof(float));
+                x0_array.hostModified();
+
+                std::cout << "Time 'GPU' (device " << name << "), " << method.second << std::endl;
+                solve_cl(method.first, a_array, b_array, x0_array, x1_array, SIZE, session, time, kernel_time);
+
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1_array.host(), EPS);
+                std::cout << std::endl;
+            }
+        }
+    } catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    // MULTIPLE RIGHT-HAND SIDES
+    try {
+        std::cout << "===========================" << std::endl
+            << "\tMULTIPLE RIGHT-HAND SIDES" << std::endl
+            << "===========================" << std::endl;
+        std::vector<float> multi_b(static_cast<size_t>(SIZE) * RHS), multi_x0(multi_b.size()), multi_x1(multi_b.size());
+        generateVector(multi_b.data(), multi_b.size());
+        std::vector<int> iters;
+        for (size_t i = 0; i < gpus.size(); i++) {
+            for (int col = 0; col < RHS; col++)
+                std::memcpy(multi_x0.data() + static_cast<size_t>(col) * SIZE, tmp, SIZE * sizeof(float));
+            std::fill(multi_x1.begin(), multi_x1.end(), 0.0f);
+
+            char name[128];
+            clGetDeviceInfo(gpus[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            std::cout << "Time 'GPU' (device " << name << "), " << RHS << " right-hand sides" << std::endl;
+
+            jacobi_multi_cl(a, multi_b.data(), multi_x0.data(), multi_x1.data(), SIZE, RHS, gpus[i], time, kernel_time, iters);
+
+            std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+            if (FLAG_CHECK) {
+                // The first and the last right-hand sides
+                checkSolutionOfSOLE(SIZE, a, multi_b.data(), multi_x1.data(), EPS);
+                const size_t last = static_cast<size_t>(RHS - 1) * SIZE;
+                checkSolutionOfSOLE(SIZE, a, multi_b.data() + last, multi_x1.data() + last, EPS);
+            }
+            std::cout << std::endl;
+        }
+    } catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
+    // MIXED PRECISION
+    try {
+        std::cout << "===========================" << std::endl
+            << "\tMIXED PRECISION (ITERATIVE REFINEMENT)" << std::endl
+            << "===========================" << std::endl;
+        std::vector<double> refine_b(b, b + SIZE), refine_x(SIZE);
+        std::vector<std::pair<cl_platform_id, cl_device_id>> devices(gpus);
+        devices.insert(devices.end(), cpus.begin(), cpus.end());
+        const std::vector<std::pair<RefineStorage, std::string>> storages = {
+            { REFINE_FP32, "fp32 A" }, { REFINE_FP16, "fp16 A" } };
+        for (size_t i = 0; i < devices.size(); i++) {
+            char name[128];
+            clGetDeviceInfo(devices[i].second, CL_DEVICE_NAME, 128, name, nullptr);
+            for (const auto& storage : storages) {
+                std::copy(tmp, tmp + SIZE, refine_x.begin());
+
+                std::cout << "Time (device " << name << "), Jacobi inner solves, " << storage.second << std::endl;
+                refine_cl(SOLVER_JACOBI, storage.first, a, refine_b.data(), refine_x.data(), SIZE, devices[i], time, kernel_time);
+
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, refine_b.data(), refine_x.data(), REFINE_EPS);
+                std::cout << std::endl;
+            }
+        }
+    } catch (Exception& exception) {
+        std::cout << exception.what() << std::endl;
+    }
+
     delete[] a;
     delete[] b;
     delete[] x0;
     delete[] x1;
-    delete[] norm;
     delete[] tmp;
 
     return 0;
@@ -1,103 +1,532 @@
 #include "../include/jacobi.h"
 
-void jacobi_cl(float* a, float* b, float* x0, float* x1, float* norm, int size,
-    cl_device_type device_type, std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time) {
+static std::string jacobiBuildOptions() {
+    return "-DJACOBI_ROWS=" + std::to_string(JACOBI_ROWS) + " -DBLOCK=" + std::to_string(JACOBI_BLOCK);
+}
+
+void jacobi_cl(float* a, float* b, float* x0, float* x1, int size,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time, const int batch,
+    JacobiKernel variant, JacobiMode mode, const float omega) {
+    Session session(dev_pair);
+    DeviceArray<float> a_array(session, a, size * size);
+    DeviceArray<float> b_array(session, b, size);
+    DeviceArray<float> x0_array(session, x0, size);
+    DeviceArray<float> x1_array(session, x1, size);
+
+    jacobi_cl(a_array, b_array, x0_array, x1_array, size, session, time, kernel_time, batch, variant, mode, omega);
+    x1_array.host();
+}
+
+int jacobi_omp(const float* a, const float* b, float* x0, float* x1, int size, timer& time, cl_ulong& kernel_time) {
+    time.first = std::chrono::high_resolution_clock::now();
+
+    // Row-major copy of A without the diagonal and the inverse diagonal, made once:
+    // a sweep is a contiguous dot product per row and allocates nothing
+    std::vector<float> r(static_cast<size_t>(size) * size);
+    std::vector<float> inv_diag(size);
+#pragma omp parallel for
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++)
+            r[static_cast<size_t>(i) * size + j] = (i != j) ? a[static_cast<size_t>(j) * size + i] : 0.0f;
+        inv_diag[i] = 1.0f / a[static_cast<size_t>(i) * size + i];
+    }
+
+    float* x_cur = x0;
+    float* x_next = x1;
+    float accuracy = 0.0;
+    int iters = 0;
+
+    const auto sweeps_start = std::chrono::high_resolution_clock::now();
+    while (true) {
+        accuracy = 0.0;
+        // The convergence check is fused into the sweep: every thread keeps the max change of its rows
+#pragma omp parallel
+        {
+            float thread_accuracy = 0.0;
+#pragma omp for
+            for (int i = 0; i < size; i++) {
+                const float* row = r.data() + static_cast<size_t>(i) * size;
+                float sum = 0.0;
+                for (int j = 0; j < size; j++)
+                    sum += row[j] * x_cur[j];
+
+                const float x = (b[i] - sum) * inv_diag[i];
+                x_next[i] = x;
+                thread_accuracy = std::max(thread_accuracy, std::fabs((x - x_cur[i]) / x_cur[i]));
+            }
+#pragma omp critical
+            accuracy = std::max(accuracy, thread_accuracy);
+        }
+        iters++;
+        std::swap(x_cur, x_next);
+
+        if (accuracy < EPS || iters >= MAX_ITERS)
+            break;
+    }
+    time.second = std::chrono::high_resolution_clock::now();
+    kernel_time = std::chrono::duration_cast<std::chrono::nanoseconds>(time.second - sweeps_start).count();
+
+    // The solution is always returned in x1
+    if (x_cur != x1)
+        std::memcpy(x1, x_cur, sizeof(float) * size);
+
+    if (accuracy < EPS)
+        std::cout << "[ INFO ] Accuracy (" << accuracy << ") is achieved (iters: " << iters << ")" << std::endl;
+    else if (iters >= MAX_ITERS)
+        std::cout << "[ INFO ] Accuracy isn't achieved (" << accuracy << "), count of iterations is exceeded" << std::endl;
+    return iters;
+}
+
+int jacobiSweeps(Session& session, cl_kernel kernel, size_t global_size, size_t group_size,
+    DeviceArray<float>& x0, DeviceArray<float>& x1, int size, const int batch, timer& time, cl_ulong& kernel_time,
+    const JacobiAcceleration* acceleration) {
     cl_int error = CL_SUCCESS;
-    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)dev_pair.first, 0 };
+    // The relative change of every sweep is reduced on the device into its own slot:
+    // only these scalars are read back, once per batch of sweeps
+    const int max_batch = (batch == JACOBI_BATCH_ADAPTIVE) ? JACOBI_MAX_BATCH : batch;
+    cl_mem norm_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(cl_int) * max_batch, nullptr, &error);
+    CONTROL("clCreateBuffer NORM", error);
 
-    cl_context context = clCreateContextFromType((nullptr == dev_pair.first) ? nullptr : properties,
-        device_type, nullptr, nullptr, &error);
-    CONTROL("clCreateContext", error);
+    CONTROL("clSetKernelArg NORM", clSetKernelArg(kernel, 4, sizeof(cl_mem), &norm_buffer));
+
+    // The previous step of the accelerated modes starts from zero
+    cl_mem d_buffer = nullptr;
+    if (acceleration != nullptr) {
+        d_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
+        CONTROL("clCreateBuffer D", error);
+        const float zero_step = 0.0f;
+        CONTROL("clEnqueueFillBuffer D", clEnqueueFillBuffer(session.queue, d_buffer, &zero_step, sizeof(float), 0, sizeof(float) * size, 0, nullptr, nullptr));
+        CONTROL("clSetKernelArg D", clSetKernelArg(kernel, 8, sizeof(cl_mem), &d_buffer));
+    }
+    // Chebyshev recurrence (Saad, Algorithm 12.1) on the spectrum [lambda_min, lambda_max] of D^-1 A
+    double theta = 1.0, delta = 0.0, sigma = 0.0, rho = 0.0;
+    if (acceleration != nullptr && acceleration->mode == JACOBI_MODE_CHEBYSHEV) {
+        theta = (acceleration->lambda_max + acceleration->lambda_min) / 2.0;
+        delta = (acceleration->lambda_max - acceleration->lambda_min) / 2.0;
+        sigma = (delta > 0.0) ? theta / delta : 0.0;
+        rho = (sigma > 0.0) ? 1.0 / sigma : 0.0;
+    }
+
+    kernel_time = 0;
+    std::vector<cl_event> evts(max_batch);
+    std::vector<cl_int> norm_bits(max_batch);
+    float accuracy = 0.0;
+    int iters = 0;
+    const cl_int zero = 0;
+    // The adaptive mode starts with a short batch and sizes the next ones by the convergence rate
+    int sweeps = (batch == JACOBI_BATCH_ADAPTIVE) ? 4 : batch;
+
+    // The iterates ping-pong between x0 and x1 on the device by swapping the kernel arguments
+    DeviceArray<float>* x_cur = &x0;
+    DeviceArray<float>* x_next = &x1;
+
+    while (true) {
+        sweeps = std::min(sweeps, MAX_ITERS - iters);
+        CONTROL("clEnqueueFillBuffer NORM", clEnqueueFillBuffer(session.queue, norm_buffer, &zero, sizeof(cl_int), 0, sizeof(cl_int) * sweeps, 0, nullptr, nullptr));
+        for (int k = 0; k < sweeps; k++) {
+            CONTROL("clSetKernelArg X0", clSetKernelArg(kernel, 2, sizeof(cl_mem), &x_cur->read()));
+            CONTROL("clSetKernelArg X1", clSetKernelArg(kernel, 3, sizeof(cl_mem), &x_next->write()));
+            CONTROL("clSetKernelArg sweep", clSetKernelArg(kernel, 7, sizeof(unsigned int), &k));
+            if (acceleration != nullptr) {
+                float c1 = 0.0f, c2 = 1.0f;
+                if (acceleration->mode == JACOBI_MODE_WEIGHTED) {
+                    c2 = acceleration->omega;
+                } else if (acceleration->mode == JACOBI_MODE_CHEBYSHEV) {
+                    if (iters + k == 0 || delta <= 0.0) {
+                        c2 = static_cast<float>(1.0 / theta);
+                    } else {
+                        const double rho_next = 1.0 / (2.0 * sigma - rho);
+                        c1 = static_cast<float>(rho_next * rho);
+                        c2 = static_cast<float>(2.0 * rho_next / delta);
+                        rho = rho_next;
+                    }
+                }
+                CONTROL("clSetKernelArg c1", clSetKernelArg(kernel, 9, sizeof(float), &c1));
+                CONTROL("clSetKernelArg c2", clSetKernelArg(kernel, 10, sizeof(float), &c2));
+            }
+            CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 1, nullptr, &global_size, &group_size, 0, nullptr, &evts[k]));
+            std::swap(x_cur, x_next);
+        }
+        CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(session.queue, norm_buffer, CL_TRUE, 0, sizeof(cl_int) * sweeps, norm_bits.data(), 0, nullptr, nullptr));
+
+        for (int k = 0; k < sweeps; k++) {
+            cl_ulong evt_start_time = 0, evt_end_time = 0;
+            CONTROL("clGetEventProfilingInfo Start", clGetEventProfilingInfo(evts[k], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &evt_start_time, nullptr));
+            CONTROL("clGetEventProfilingInfo End", clGetEventProfilingInfo(evts[k], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &evt_end_time, nullptr));
+            kernel_time += evt_end_time - evt_start_time;
+            clReleaseEvent(evts[k]);
+        }
+
+        // The iteration count is the first sweep of the batch that met the tolerance,
+        // the sweeps enqueued after it only refine the returned solution further
+        float first_accuracy = 0.0;
+        int converged = -1;
+        for (int k = 0; k < sweeps; k++) {
+            std::memcpy(&accuracy, &norm_bits[k], sizeof(float));
+            if (k == 0)
+                first_accuracy = accuracy;
+            if (accuracy < EPS) {
+                converged = k;
+                break;
+            }
+        }
+        if (converged >= 0) {
+            iters += converged + 1;
+            break;
+        }
+        iters += sweeps;
+        if (iters >= MAX_ITERS)
+            break;
+
+        if (batch == JACOBI_BATCH_ADAPTIVE && sweeps > 1) {
+            // Geometric rate of the batch -> the sweeps still needed to reach EPS
+            const double rate = std::pow(accuracy / first_accuracy, 1.0 / (sweeps - 1));
+            int needed = JACOBI_MAX_BATCH;
+            if (rate > 0.0 && rate < 1.0)
+                needed = static_cast<int>(std::ceil(std::log(EPS / accuracy) / std::log(rate)));
+            sweeps = std::max(2, std::min(needed, JACOBI_MAX_BATCH));
+        }
+    }
+    time.second = std::chrono::high_resolution_clock::now();
+
+    // The solution is always returned in x1
+    if (x_cur != &x1) {
+        CONTROL("clEnqueueCopyBuffer", clEnqueueCopyBuffer(session.queue, x_cur->read(), x1.write(), 0, 0, sizeof(float) * size, 0, nullptr, nullptr));
+    }
+    CONTROL("clFinish", clFinish(session.queue));
+
+    if (accuracy < EPS)
+        std::cout << "[ INFO ] Accuracy (" << accuracy << ") is achieved (iters: " << iters << ")" << std::endl;
+    else if (iters >= MAX_ITERS)
+        std::cout << "[ INFO ] Accuracy isn't achieved (" << accuracy << "), count of iterations is exceeded" << std::endl;
+
+    if (d_buffer != nullptr)
+        clReleaseMemObject(d_buffer);
+    clReleaseMemObject(norm_buffer);
+    return iters;
+}
+
+// A few power iterations with D^-1 A on the device: the dominant eigenvalue gives lambda_max, the one of
+// lambda_max * I - D^-1 A gives lambda_max - lambda_min. Power iterations approach the extreme eigenvalues
+// from inside, so the bounds are widened by SPECTRUM_MARGIN to keep Chebyshev stable
+static void estimateSpectrum(cl_program program, DeviceArray<float>& a, int size, Session& session,
+    float& lambda_min, float& lambda_max) {
+    cl_int error = CL_SUCCESS;
+    cl_kernel kernel = clCreateKernel(program, "jacobi_operator", &error);
+    CONTROL("clCreateKernel jacobi_operator", error);
+
+    DeviceArray<float> v(session, size);
+    DeviceArray<float> w(session, size);
+    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 0, sizeof(cl_mem), &a.read()));
+    CONTROL("clSetKernelArg size", clSetKernelArg(kernel, 3, sizeof(unsigned int), &size));
+    const size_t global_size = size;
+
+    auto dominant = [&](float shift, float sign) {
+        float* v_host = v.host();
+        for (int i = 0; i < size; i++)
+            v_host[i] = 1.0f + 0.5f * std::sin(static_cast<float>(i));
+        v.hostModified();
+
+        double lambda = 0.0;
+        for (int step = 0; step < POWER_STEPS; step++) {
+            CONTROL("clSetKernelArg V", clSetKernelArg(kernel, 1, sizeof(cl_mem), &v.read()));
+            CONTROL("clSetKernelArg W", clSetKernelArg(kernel, 2, sizeof(cl_mem), &w.write()));
+            CONTROL("clSetKernelArg shift", clSetKernelArg(kernel, 4, sizeof(float), &shift));
+            CONTROL("clSetKernelArg sign", clSetKernelArg(kernel, 5, sizeof(float), &sign));
+            CONTROL("clEnqueueNDRangeKernel jacobi_operator", clEnqueueNDRangeKernel(session.queue, kernel, 1, nullptr, &global_size, nullptr, 0, nullptr, nullptr));
+
+            // Rayleigh quotient and normalization of a single vector on the host
+            const float* v_cur = v.host();
+            const float* w_cur = w.host();
+            double vw = 0.0, vv = 0.0, ww = 0.0;
+            for (int i = 0; i < size; i++) {
+                vw += static_cast<double>(v_cur[i]) * w_cur[i];
+                vv += static_cast<double>(v_cur[i]) * v_cur[i];
+                ww += static_cast<double>(w_cur[i]) * w_cur[i];
+            }
+            lambda = vw / vv;
+            float* v_next = v.host();
+            const double scale = 1.0 / std::sqrt(ww);
+            for (int i = 0; i < size; i++)
+                v_next[i] = static_cast<float>(w_cur[i] * scale);
+            v.hostModified();
+        }
+        return lambda;
+    };
+
+    const double max_estimate = dominant(0.0f, 1.0f);
+    const double width_estimate = dominant(static_cast<float>(max_estimate), -1.0f);
+    lambda_max = static_cast<float>(max_estimate * (1.0 + SPECTRUM_MARGIN));
+    lambda_min = static_cast<float>(std::max((max_estimate - width_estimate) * (1.0 - SPECTRUM_MARGIN), 1e-3 * max_estimate));
+
+    clReleaseKernel(kernel);
+}
 
-    cl_queue_properties props[3] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
-    cl_command_queue queue = clCreateCommandQueueWithProperties(context, dev_pair.second, props, &error);
-    CONTROL("clCreateCommandQueue", error);
+int jacobi_cl(DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0, DeviceArray<float>& x1,
+    int size, Session& session, timer& time, cl_ulong& kernel_time, const int batch,
+    JacobiKernel variant, JacobiMode mode, const float omega) {
+    cl_int error = CL_SUCCESS;
+    cl_program program = session.getProgram("kernels/jacobi_kernel.cl", jacobiBuildOptions());
 
-    cl_program program = createProgramFromSource(context, "kernels/jacobi_kernel.cl");
-    CONTROL("clBuildProgram", clBuildProgram(program, 1, &dev_pair.second, nullptr, nullptr, nullptr));
+    if (variant == JACOBI_KERNEL_AUTO) {
+        cl_device_type device_type = 0;
+        clGetDeviceInfo(session.device, CL_DEVICE_TYPE, sizeof(cl_device_type), &device_type, nullptr);
+        variant = (device_type & CL_DEVICE_TYPE_CPU) ? JACOBI_KERNEL_COLUMNS : JACOBI_KERNEL_ROWS;
+    }
+    const char* kernel_name = variant == JACOBI_KERNEL_ROWS ? "jacobi_rows" :
+        variant == JACOBI_KERNEL_COLUMNS ? "jacobi_columns" : "jacobi";
 
-    cl_kernel kernel = clCreateKernel(program, "jacobi", &error);
+    cl_kernel kernel = clCreateKernel(program, kernel_name, &error);
     CONTROL("clCreateKernel", error);
 
-    cl_mem a_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * size * size, nullptr, &error);
-    CONTROL("clCreateBuffer A", error);
-    cl_mem b_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * size, nullptr, &error);
-    CONTROL("clCreateBuffer B", error);
-    cl_mem x0_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
-    CONTROL("clCreateBuffer X0", error);
-    cl_mem x1_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
-    CONTROL("clCreateBuffer X1", error);
-    cl_mem norm_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * size, nullptr, &error);
-    CONTROL("clCreateBuffer NORM", error);
+    size_t group_size = 0;
+    clGetKernelWorkGroupInfo(kernel, session.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &group_size, nullptr);
+    // The tree reductions in the kernels need a power of 2
+    while ((group_size & (group_size - 1)) != 0)
+        group_size &= group_size - 1;
+    size_t global_size = (size % group_size == 0) ? size : size + group_size - size % group_size;
+    size_t scratch_size = sizeof(float) * group_size;
 
-    CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(queue, a_buffer, CL_TRUE, 0, sizeof(float) * size * size, a, 0, nullptr, nullptr));
-    CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(queue, b_buffer, CL_TRUE, 0, sizeof(float) * size, b, 0, nullptr, nullptr));
-    CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(queue, x0_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, nullptr, nullptr));
-    CONTROL("clEnqueueWriteBuffer X1", clEnqueueWriteBuffer(queue, x1_buffer, CL_TRUE, 0, sizeof(float) * size, x1, 0, nullptr, nullptr));
-    CONTROL("clEnqueueWriteBuffer NORM", clEnqueueWriteBuffer(queue, norm_buffer, CL_TRUE, 0, sizeof(float) * size, norm, 0, nullptr, nullptr));
+    time.first = std::chrono::high_resolution_clock::now();
 
-    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 0, sizeof(cl_mem), &a_buffer));
-    CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 1, sizeof(cl_mem), &b_buffer));
-    CONTROL("clSetKernelArg X0", clSetKernelArg(kernel, 2, sizeof(cl_mem), &x0_buffer));
-    CONTROL("clSetKernelArg X1", clSetKernelArg(kernel, 3, sizeof(cl_mem), &x1_buffer));
-    CONTROL("clSetKernelArg NORM", clSetKernelArg(kernel, 4, sizeof(cl_mem), &norm_buffer));
+    // The off-diagonal part and the inverse diagonal are split out of A once per solve
+    cl_mem r_buffer = nullptr, inv_diag_buffer = nullptr;
+    if (variant != JACOBI_KERNEL_BASIC) {
+        const bool row_major = variant == JACOBI_KERNEL_ROWS;
+        if (row_major) {
+            group_size = std::min(group_size, static_cast<size_t>(128));
+            global_size = (size + JACOBI_ROWS - 1) / JACOBI_ROWS * group_size;
+            scratch_size = sizeof(float) * group_size * JACOBI_ROWS;
+        }
+        const size_t tile = 4 * group_size;
+        const unsigned int ld = row_major ? static_cast<unsigned int>((size + tile - 1) / tile * tile) : size;
+
+        r_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(float) * ld * size, nullptr, &error);
+        CONTROL("clCreateBuffer R", error);
+        inv_diag_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
+        CONTROL("clCreateBuffer inv_diag", error);
+
+        cl_kernel prepare = clCreateKernel(program, "jacobi_prepare", &error);
+        CONTROL("clCreateKernel jacobi_prepare", error);
+        const cl_int row_major_arg = row_major ? 1 : 0;
+        CONTROL("clSetKernelArg A", clSetKernelArg(prepare, 0, sizeof(cl_mem), &a.read()));
+        CONTROL("clSetKernelArg R", clSetKernelArg(prepare, 1, sizeof(cl_mem), &r_buffer));
+        CONTROL("clSetKernelArg inv_diag", clSetKernelArg(prepare, 2, sizeof(cl_mem), &inv_diag_buffer));
+        CONTROL("clSetKernelArg size", clSetKernelArg(prepare, 3, sizeof(unsigned int), &size));
+        CONTROL("clSetKernelArg ld", clSetKernelArg(prepare, 4, sizeof(unsigned int), &ld));
+        CONTROL("clSetKernelArg row_major", clSetKernelArg(prepare, 5, sizeof(cl_int), &row_major_arg));
+        const size_t prepare_size[2] = { row_major ? ld : static_cast<size_t>(size), static_cast<size_t>(size) };
+        CONTROL("clEnqueueNDRangeKernel jacobi_prepare", clEnqueueNDRangeKernel(session.queue, prepare, 2, nullptr, prepare_size, nullptr, 0, nullptr, nullptr));
+        clReleaseKernel(prepare);
+
+        CONTROL("clSetKernelArg inv_diag", clSetKernelArg(kernel, 11, sizeof(cl_mem), &inv_diag_buffer));
+        CONTROL("clSetKernelArg ld", clSetKernelArg(kernel, 12, sizeof(unsigned int), &ld));
+    }
+
+    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 0, sizeof(cl_mem), r_buffer != nullptr ? &r_buffer : &a.read()));
+    CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 1, sizeof(cl_mem), &b.read()));
     CONTROL("clSetKernelArg size", clSetKernelArg(kernel, 5, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg scratch", clSetKernelArg(kernel, 6, scratch_size, nullptr));
+
+    JacobiAcceleration acceleration;
+    acceleration.mode = mode;
+    acceleration.omega = omega;
+    if (mode == JACOBI_MODE_CHEBYSHEV) {
+        estimateSpectrum(program, a, size, session, acceleration.lambda_min, acceleration.lambda_max);
+        std::cout << "[ INFO ] Spectrum of D^-1 A: [" << acceleration.lambda_min << ", " << acceleration.lambda_max << "]" << std::endl;
+    }
+
+    const int iters = jacobiSweeps(session, kernel, global_size, group_size, x0, x1, size, batch, time, kernel_time, &acceleration);
+
+    if (r_buffer != nullptr) {
+        clReleaseMemObject(r_buffer);
+        clReleaseMemObject(inv_diag_buffer);
+    }
+    clReleaseKernel(kernel);
+    return iters;
+}
+
+cl_mem createHalfMatrix(DeviceArray<float>& a, int size, Session& session) {
+    const float* host_a = a.host();
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+        max_abs = std::max(max_abs, std::fabs(host_a[i]));
+    if (max_abs > HALF_MAX) {
+        std::cout << "[ INFO ] max|A| (" << max_abs << ") is out of the fp16 range, A isn't stored as half" << std::endl;
+        return nullptr;
+    }
+
+    cl_int error = CL_SUCCESS;
+    cl_program program = session.getProgram("kernels/jacobi_kernel.cl", jacobiBuildOptions());
+    cl_kernel kernel = clCreateKernel(program, "to_half", &error);
+    CONTROL("clCreateKernel", error);
+
+    const unsigned int count = static_cast<unsigned int>(size) * size;
+    cl_mem a_half = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(cl_half) * count, nullptr, &error);
+    CONTROL("clCreateBuffer A_HALF", error);
+
+    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 0, sizeof(cl_mem), &a.read()));
+    CONTROL("clSetKernelArg A_HALF", clSetKernelArg(kernel, 1, sizeof(cl_mem), &a_half));
+    CONTROL("clSetKernelArg count", clSetKernelArg(kernel, 2, sizeof(unsigned int), &count));
+    const size_t global_size = count;
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 1, nullptr, &global_size, nullptr, 0, nullptr, nullptr));
+
+    clReleaseKernel(kernel);
+    return a_half;
+}
+
+int jacobi_half_cl(cl_mem a_half, DeviceArray<float>& b, DeviceArray<float>& x0, DeviceArray<float>& x1,
+    int size, Session& session, timer& time, cl_ulong& kernel_time, const int batch) {
+    cl_int error = CL_SUCCESS;
+    cl_program program = session.getProgram("kernels/jacobi_kernel.cl", jacobiBuildOptions());
+    cl_kernel kernel = clCreateKernel(program, "jacobi_half", &error);
+    CONTROL("clCreateKernel", error);
 
     size_t group_size = 0;
-    clGetKernelWorkGroupInfo(kernel, dev_pair.second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &group_size, nullptr);
+    clGetKernelWorkGroupInfo(kernel, session.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &group_size, nullptr);
+    // The tree reduction in the kernel needs a power of 2
+    while ((group_size & (group_size - 1)) != 0)
+        group_size &= group_size - 1;
     const size_t global_size = (size % group_size == 0) ? size : size + group_size - size % group_size;
 
+    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 0, sizeof(cl_mem), &a_half));
+    CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 1, sizeof(cl_mem), &b.read()));
+    CONTROL("clSetKernelArg size", clSetKernelArg(kernel, 5, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg scratch", clSetKernelArg(kernel, 6, sizeof(float) * group_size, nullptr));
+
+    time.first = std::chrono::high_resolution_clock::now();
+    const int iters = jacobiSweeps(session, kernel, global_size, group_size, x0, x1, size, batch, time, kernel_time);
+
+    clReleaseKernel(kernel);
+    return iters;
+}
+
+void jacobi_multi_cl(float* a, float* b, float* x0, float* x1, int size, int rhs,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time, std::vector<int>& iters) {
+    Session session(dev_pair);
+    DeviceArray<float> a_array(session, a, size * size);
+    DeviceArray<float> b_array(session, b, size * rhs);
+    DeviceArray<float> x0_array(session, x0, size * rhs);
+    DeviceArray<float> x1_array(session, x1, size * rhs);
+
+    jacobi_multi_cl(a_array, b_array, x0_array, x1_array, size, rhs, session, time, kernel_time, iters);
+    x1_array.host();
+}
+
+void jacobi_multi_cl(DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0, DeviceArray<float>& x1,
+    int size, int rhs, Session& session, timer& time, cl_ulong& kernel_time, std::vector<int>& iters) {
+    cl_int error = CL_SUCCESS;
+    cl_program program = session.getProgram("kernels/jacobi_kernel.cl", jacobiBuildOptions());
+
+    cl_kernel kernel = clCreateKernel(program, "jacobi_multi", &error);
+    CONTROL("clCreateKernel", error);
+
+    size_t max_group_size = 0;
+    CONTROL("clGetKernelWorkGroupInfo", clGetKernelWorkGroupInfo(kernel, session.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_group_size, nullptr));
+    if (max_group_size < JACOBI_BLOCK * JACOBI_BLOCK) {
+        // The tiles don't fit a work-group of the device: the basic kernel solves the columns one by one
+        clReleaseKernel(kernel);
+        float* b_host = b.host();
+        float* x0_host = x0.host();
+        float* x1_host = x1.host();
+        kernel_time = 0;
+        iters.assign(rhs, 0);
+        time.first = std::chrono::high_resolution_clock::now();
+        for (int col = 0; col < rhs; col++) {
+            const size_t offset = static_cast<size_t>(col) * size;
+            DeviceArray<float> b_col(session, b_host + offset, size);
+            DeviceArray<float> x0_col(session, x0_host + offset, size);
+            DeviceArray<float> x1_col(session, x1_host + offset, size);
+            timer col_time;
+            cl_ulong col_kernel_time = 0;
+            iters[col] = jacobi_cl(a, b_col, x0_col, x1_col, size, session, col_time, col_kernel_time);
+            x1_col.host();
+            kernel_time += col_kernel_time;
+        }
+        x1.hostModified();
+        time.second = std::chrono::high_resolution_clock::now();
+        return;
+    }
+
+    cl_mem norm_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(cl_int) * rhs, nullptr, &error);
+    CONTROL("clCreateBuffer NORM", error);
+    cl_mem cols_buffer = clCreateBuffer(session.context, CL_MEM_READ_ONLY, sizeof(cl_int) * rhs, nullptr, &error);
+    CONTROL("clCreateBuffer cols", error);
+
+    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 0, sizeof(cl_mem), &a.read()));
+    CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 1, sizeof(cl_mem), &b.read()));
+    CONTROL("clSetKernelArg NORM", clSetKernelArg(kernel, 4, sizeof(cl_mem), &norm_buffer));
+    CONTROL("clSetKernelArg size", clSetKernelArg(kernel, 5, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg cols", clSetKernelArg(kernel, 6, sizeof(cl_mem), &cols_buffer));
+
     kernel_time = 0;
-    cl_event evt;
+    iters.assign(rhs, 0);
+    // Columns still iterating, and for every column whether its latest iterate is in x1
+    std::vector<cl_int> cols(rhs);
+    for (int col = 0; col < rhs; col++)
+        cols[col] = col;
+    std::vector<char> latest_in_x1(rhs, 0);
+    std::vector<cl_int> norm_bits(rhs);
+    const cl_int zero = 0;
+    const size_t local[2] = { JACOBI_BLOCK, JACOBI_BLOCK };
     float accuracy = 0.0;
-    int iters = 0;
+    int sweeps = 0;
+
+    DeviceArray<float>* x_cur = &x0;
+    DeviceArray<float>* x_next = &x1;
 
     time.first = std::chrono::high_resolution_clock::now();
-    while (true) {
-        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &global_size, &group_size, 0, nullptr, &evt));
-        CONTROL("clWaitForEvents", clWaitForEvents(1, &evt));
+    while (!cols.empty() && sweeps < MAX_ITERS) {
+        const unsigned int active = static_cast<unsigned int>(cols.size());
+        CONTROL("clEnqueueWriteBuffer cols", clEnqueueWriteBuffer(session.queue, cols_buffer, CL_TRUE, 0, sizeof(cl_int) * active, cols.data(), 0, nullptr, nullptr));
+        CONTROL("clEnqueueFillBuffer NORM", clEnqueueFillBuffer(session.queue, norm_buffer, &zero, sizeof(cl_int), 0, sizeof(cl_int) * rhs, 0, nullptr, nullptr));
+        CONTROL("clSetKernelArg X0", clSetKernelArg(kernel, 2, sizeof(cl_mem), &x_cur->read()));
+        CONTROL("clSetKernelArg X1", clSetKernelArg(kernel, 3, sizeof(cl_mem), &x_next->write()));
+        CONTROL("clSetKernelArg active", clSetKernelArg(kernel, 7, sizeof(unsigned int), &active));
+
+        const size_t global[2] = { (static_cast<size_t>(size) + JACOBI_BLOCK - 1) / JACOBI_BLOCK * JACOBI_BLOCK,
+            (active + JACOBI_BLOCK - 1) / JACOBI_BLOCK * JACOBI_BLOCK };
+        cl_event evt;
+        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 2, nullptr, global, local, 0, nullptr, &evt));
+        CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(session.queue, norm_buffer, CL_TRUE, 0, sizeof(cl_int) * rhs, norm_bits.data(), 0, nullptr, nullptr));
 
         cl_ulong evt_start_time = 0, evt_end_time = 0;
         CONTROL("clGetEventProfilingInfo Start", clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &evt_start_time, nullptr));
         CONTROL("clGetEventProfilingInfo End", clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &evt_end_time, nullptr));
         kernel_time += evt_end_time - evt_start_time;
+        clReleaseEvent(evt);
+        sweeps++;
 
-        CONTROL("clEnqueueReadBuffer X1", clEnqueueReadBuffer(queue, x1_buffer, CL_TRUE, 0, sizeof(float) * size, x1, 0, NULL, NULL));
-        CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(queue, norm_buffer, CL_TRUE, 0, sizeof(float) * size, norm, 0, NULL, NULL));
-
-        accuracy = std::numeric_limits<float>::min();
-        for (size_t i = 0; i < size; ++i) {
-            if (fabs(norm[i] / x0[i]) > accuracy)
-                accuracy = fabs(norm[i] / x0[i]);
+        // Converged columns are masked out of the next sweeps
+        std::vector<cl_int> still_active;
+        for (const cl_int col : cols) {
+            iters[col] = sweeps;
+            latest_in_x1[col] = x_next == &x1;
+            std::memcpy(&accuracy, &norm_bits[col], sizeof(float));
+            if (accuracy >= EPS)
+                still_active.push_back(col);
         }
-        iters++;
-
-        std::swap(x0, x1);
-
-        if (accuracy < EPS || iters >= MAX_ITERS)
-            break;
+        cols.swap(still_active);
+        std::swap(x_cur, x_next);
+    }
 
-        CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(queue, x0_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, NULL, NULL));
+    // The solution of every column is returned in x1
+    for (int col = 0; col < rhs; col++) {
+        if (!latest_in_x1[col]) {
+            const size_t offset = sizeof(float) * col * size;
+            CONTROL("clEnqueueCopyBuffer", clEnqueueCopyBuffer(session.queue, x0.read(), x1.readWrite(), offset, offset, sizeof(float) * size, 0, nullptr, nullptr));
+        }
     }
+    CONTROL("clFinish", clFinish(session.queue));
     time.second = std::chrono::high_resolution_clock::now();
 
-    CONTROL("clFinish", clFinish(queue));
-
-
-    CONTROL("clEnqueueReadBuffer", clEnqueueReadBuffer(queue, x0_buffer, CL_TRUE, 0, size * sizeof(float), x1, 0, nullptr, nullptr));
-
-    if (accuracy < EPS)
-        std::cout << "[ INFO ] Accuracy (" << accuracy << ") is achieved (iters: " << iters << ")" << std::endl;
-    else if (iters >= MAX_ITERS)
-        std::cout << "[ INFO ] Accuracy isn't achieved (" << accuracy << "), count of iterations is exceeded" << std::endl;
+    if (cols.empty())
+        std::cout << "[ INFO ] Accuracy is achieved for all " << rhs << " right-hand sides (iters: " <<
+            *std::min_element(iters.begin(), iters.end()) << " - " << *std::max_element(iters.begin(), iters.end()) << ")" << std::endl;
+    else
+        std::cout << "[ INFO ] Accuracy isn't achieved for " << cols.size() << " right-hand sides, count of iterations is exceeded" << std::endl;
 
-    clReleaseMemObject(a_buffer);
-    clReleaseMemObject(b_buffer);
-    clReleaseMemObject(x0_buffer);
-    clReleaseMemObject(x1_buffer);
+    clReleaseMemObject(cols_buffer);
     clReleaseMemObject(norm_buffer);
-    clReleaseProgram(program);
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
-}
\ No newline at end of file
+}
@@ -0,0 +1,423 @@
+#include "../include/solvers.h"
+
+// CG keeps its scalars on the device: (r, z) of two consecutive iterations ping-pong
+// between the first two slots, (p, A p) is the third
+#define SLOT_PQ 2
+
+static size_t reductionGroupSize(Session& session, const std::vector<cl_kernel>& kernels) {
+    size_t group_size = 0;
+    for (cl_kernel kernel : kernels) {
+        size_t kernel_group_size = 0;
+        clGetKernelWorkGroupInfo(kernel, session.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernel_group_size, nullptr);
+        group_size = (group_size == 0) ? kernel_group_size : std::min(group_size, kernel_group_size);
+    }
+    // The tree reductions in the kernels need a power of 2
+    while ((group_size & (group_size - 1)) != 0)
+        group_size &= group_size - 1;
+    return group_size;
+}
+
+static void enqueueKernel(Session& session, cl_kernel kernel, size_t global_size, size_t group_size, std::vector<cl_event>& evts) {
+    global_size = (global_size + group_size - 1) / group_size * group_size;
+    cl_event evt;
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 1, nullptr, &global_size, &group_size, 0, nullptr, &evt));
+    evts.push_back(evt);
+}
+
+// Adds the execution time of the completed kernels and releases their events
+static void collectKernelTime(std::vector<cl_event>& evts, cl_ulong& kernel_time) {
+    for (cl_event evt : evts) {
+        cl_ulong evt_start_time = 0, evt_end_time = 0;
+        CONTROL("clGetEventProfilingInfo Start", clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &evt_start_time, nullptr));
+        CONTROL("clGetEventProfilingInfo End", clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &evt_end_time, nullptr));
+        kernel_time += evt_end_time - evt_start_time;
+        clReleaseEvent(evt);
+    }
+    evts.clear();
+}
+
+static float readNorm(Session& session, cl_mem norm_buffer) {
+    cl_int norm_bits = 0;
+    float accuracy = 0.0;
+    CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(session.queue, norm_buffer, CL_TRUE, 0, sizeof(cl_int), &norm_bits, 0, nullptr, nullptr));
+    std::memcpy(&accuracy, &norm_bits, sizeof(float));
+    return accuracy;
+}
+
+static void printConvergence(float accuracy, int iters) {
+    if (accuracy < EPS)
+        std::cout << "[ INFO ] Accuracy (" << accuracy << ") is achieved (iters: " << iters << ")" << std::endl;
+    else
+        std::cout << "[ INFO ] Accuracy isn't achieved (" << accuracy << "), count of iterations is exceeded" << std::endl;
+}
+
+static int conjugateGradient(const bool preconditioned, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0,
+    DeviceArray<float>& x1, int size, Session& session, timer& time, cl_ulong& kernel_time) {
+    cl_int error = CL_SUCCESS;
+    cl_program program = session.getProgram("kernels/solvers_kernel.cl");
+
+    const char* names[] = { "residual", "matvec", "inverse_diagonal", "precondition", "dot_partial", "dot_finalize",
+        "cg_step", "cg_direction", "relative_residual" };
+    std::vector<cl_kernel> kernels;
+    for (const char* name : names) {
+        kernels.push_back(clCreateKernel(program, name, &error));
+        CONTROL(std::string("clCreateKernel ") + name, error);
+    }
+    cl_kernel residual = kernels[0], matvec = kernels[1], inverse_diagonal = kernels[2], precondition = kernels[3],
+        dot_partial = kernels[4], dot_finalize = kernels[5], cg_step = kernels[6], cg_direction = kernels[7],
+        relative_residual = kernels[8];
+    const size_t group_size = reductionGroupSize(session, { dot_partial, dot_finalize, relative_residual });
+
+    std::vector<cl_mem> buffers;
+    auto createBuffer = [&](size_t bytes) {
+        buffers.push_back(clCreateBuffer(session.context, CL_MEM_READ_WRITE, bytes, nullptr, &error));
+        CONTROL("clCreateBuffer", error);
+        return buffers.back();
+    };
+    cl_mem r = createBuffer(sizeof(float) * size);
+    cl_mem p = createBuffer(sizeof(float) * size);
+    cl_mem q = createBuffer(sizeof(float) * size);
+    // Without the preconditioner z is r itself
+    cl_mem z = preconditioned ? createBuffer(sizeof(float) * size) : r;
+    cl_mem inv_diag = preconditioned ? createBuffer(sizeof(float) * size) : nullptr;
+    cl_mem partials = createBuffer(sizeof(float) * DOT_GROUPS);
+    cl_mem scalars = createBuffer(sizeof(float) * 3);
+    cl_mem norm_buffer = createBuffer(sizeof(cl_int));
+    const unsigned int groups = DOT_GROUPS;
+    const unsigned int pq_slot = SLOT_PQ;
+    const cl_int zero = 0;
+
+    std::vector<cl_event> evts;
+    auto dot = [&](cl_mem x, cl_mem y, unsigned int slot) {
+        CONTROL("clSetKernelArg x", clSetKernelArg(dot_partial, 0, sizeof(cl_mem), &x));
+        CONTROL("clSetKernelArg y", clSetKernelArg(dot_partial, 1, sizeof(cl_mem), &y));
+        CONTROL("clSetKernelArg slot", clSetKernelArg(dot_finalize, 3, sizeof(unsigned int), &slot));
+        enqueueKernel(session, dot_partial, DOT_GROUPS * group_size, group_size, evts);
+        enqueueKernel(session, dot_finalize, group_size, group_size, evts);
+    };
+
+    CONTROL("clSetKernelArg", clSetKernelArg(residual, 0, sizeof(cl_mem), &a.read()));
+    CONTROL("clSetKernelArg", clSetKernelArg(residual, 1, sizeof(cl_mem), &b.read()));
+    CONTROL("clSetKernelArg", clSetKernelArg(residual, 2, sizeof(cl_mem), &x1.write()));
+    CONTROL("clSetKernelArg", clSetKernelArg(residual, 3, sizeof(cl_mem), &r));
+    CONTROL("clSetKernelArg", clSetKernelArg(residual, 4, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg", clSetKernelArg(matvec, 0, sizeof(cl_mem), &a.read()));
+    CONTROL("clSetKernelArg", clSetKernelArg(matvec, 1, sizeof(cl_mem), &p));
+    CONTROL("clSetKernelArg", clSetKernelArg(matvec, 2, sizeof(cl_mem), &q));
+    CONTROL("clSetKernelArg", clSetKernelArg(matvec, 3, sizeof(unsigned int), &size));
+    if (preconditioned) {
+        CONTROL("clSetKernelArg", clSetKernelArg(inverse_diagonal, 0, sizeof(cl_mem), &a.read()));
+        CONTROL("clSetKernelArg", clSetKernelArg(inverse_diagonal, 1, sizeof(cl_mem), &inv_diag));
+        CONTROL("clSetKernelArg", clSetKernelArg(inverse_diagonal, 2, sizeof(unsigned int), &size));
+        CONTROL("clSetKernelArg", clSetKernelArg(precondition, 0, sizeof(cl_mem), &r));
+        CONTROL("clSetKernelArg", clSetKernelArg(precondition, 1, sizeof(cl_mem), &inv_diag));
+        CONTROL("clSetKernelArg", clSetKernelArg(precondition, 2, sizeof(cl_mem), &z));
+        CONTROL("clSetKernelArg", clSetKernelArg(precondition, 3, sizeof(unsigned int), &size));
+    }
+    CONTROL("clSetKernelArg", clSetKernelArg(dot_partial, 2, sizeof(cl_mem), &partials));
+    CONTROL("clSetKernelArg", clSetKernelArg(dot_partial, 3, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg", clSetKernelArg(dot_partial, 4, sizeof(float) * group_size, nullptr));
+    CONTROL("clSetKernelArg", clSetKernelArg(dot_finalize, 0, sizeof(cl_mem), &partials));
+    CONTROL("clSetKernelArg", clSetKernelArg(dot_finalize, 1, sizeof(unsigned int), &groups));
+    CONTROL("clSetKernelArg", clSetKernelArg(dot_finalize, 2, sizeof(cl_mem), &scalars));
+    CONTROL("clSetKernelArg", clSetKernelArg(dot_finalize, 4, sizeof(float) * group_size, nullptr));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_step, 0, sizeof(cl_mem), &x1.write()));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_step, 1, sizeof(cl_mem), &r));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_step, 2, sizeof(cl_mem), &p));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_step, 3, sizeof(cl_mem), &q));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_step, 4, sizeof(cl_mem), &scalars));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_step, 6, sizeof(unsigned int), &pq_slot));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_step, 7, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_direction, 0, sizeof(cl_mem), &z));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_direction, 1, sizeof(cl_mem), &p));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_direction, 2, sizeof(cl_mem), &scalars));
+    CONTROL("clSetKernelArg", clSetKernelArg(cg_direction, 5, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg", clSetKernelArg(relative_residual, 0, sizeof(cl_mem), &r));
+    CONTROL("clSetKernelArg", clSetKernelArg(relative_residual, 1, sizeof(cl_mem), &b.read()));
+    CONTROL("clSetKernelArg", clSetKernelArg(relative_residual, 2, sizeof(cl_mem), &norm_buffer));
+    CONTROL("clSetKernelArg", clSetKernelArg(relative_residual, 3, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg", clSetKernelArg(relative_residual, 4, sizeof(float) * group_size, nullptr));
+
+    kernel_time = 0;
+    time.first = std::chrono::high_resolution_clock::now();
+
+    // x = x0, r = b - A x, z = M^-1 r, p = z
+    CONTROL("clEnqueueCopyBuffer", clEnqueueCopyBuffer(session.queue, x0.read(), x1.write(), 0, 0, sizeof(float) * size, 0, nullptr, nullptr));
+    enqueueKernel(session, residual, size, group_size, evts);
+    if (preconditioned) {
+        enqueueKernel(session, inverse_diagonal, size, group_size, evts);
+        enqueueKernel(session, precondition, size, group_size, evts);
+    }
+    CONTROL("clEnqueueCopyBuffer", clEnqueueCopyBuffer(session.queue, z, p, 0, 0, sizeof(float) * size, 0, nullptr, nullptr));
+    unsigned int rz_slot = 0;
+    dot(r, z, rz_slot);
+
+    float accuracy = 0.0;
+    int iters = 0;
+    while (true) {
+        // Only max |r / b| crosses the bus per iteration
+        CONTROL("clEnqueueFillBuffer NORM", clEnqueueFillBuffer(session.queue, norm_buffer, &zero, sizeof(cl_int), 0, sizeof(cl_int), 0, nullptr, nullptr));
+        enqueueKernel(session, relative_residual, size, group_size, evts);
+        accuracy = readNorm(session, norm_buffer);
+        collectKernelTime(evts, kernel_time);
+        if (accuracy < EPS || iters >= MAX_ITERS)
+            break;
+
+        // q = A p, x += alpha p, r -= alpha q
+        enqueueKernel(session, matvec, size, group_size, evts);
+        dot(p, q, SLOT_PQ);
+        CONTROL("clSetKernelArg rz_slot", clSetKernelArg(cg_step, 5, sizeof(unsigned int), &rz_slot));
+        enqueueKernel(session, cg_step, size, group_size, evts);
+
+        // z = M^-1 r, p = z + beta p
+        if (preconditioned)
+            enqueueKernel(session, precondition, size, group_size, evts);
+        const unsigned int rz_new_slot = 1 - rz_slot;
+        dot(r, z, rz_new_slot);
+        CONTROL("clSetKernelArg rz_new_slot", clSetKernelArg(cg_direction, 3, sizeof(unsigned int), &rz_new_slot));
+        CONTROL("clSetKernelArg rz_old_slot", clSetKernelArg(cg_direction, 4, sizeof(unsigned int), &rz_slot));
+        enqueueKernel(session, cg_direction, size, group_size, evts);
+        rz_slot = rz_new_slot;
+        iters++;
+    }
+    time.second = std::chrono::high_resolution_clock::now();
+    printConvergence(accuracy, iters);
+
+    for (cl_mem buffer : buffers)
+        clReleaseMemObject(buffer);
+    for (cl_kernel kernel : kernels)
+        clReleaseKernel(kernel);
+    return iters;
+}
+
+static int redBlackSor(const float omega, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0,
+    DeviceArray<float>& x1, int size, Session& session, timer& time, cl_ulong& kernel_time) {
+    cl_int error = CL_SUCCESS;
+    cl_program program = session.getProgram("kernels/solvers_kernel.cl");
+
+    cl_kernel kernel = clCreateKernel(program, "sor_color", &error);
+    CONTROL("clCreateKernel", error);
+    const size_t group_size = reductionGroupSize(session, { kernel });
+
+    cl_mem norm_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(cl_int), nullptr, &error);
+    CONTROL("clCreateBuffer NORM", error);
+
+    CONTROL("clSetKernelArg A", clSetKernelArg(kernel, 0, sizeof(cl_mem), &a.read()));
+    CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 1, sizeof(cl_mem), &b.read()));
+    CONTROL("clSetKernelArg NORM", clSetKernelArg(kernel, 4, sizeof(cl_mem), &norm_buffer));
+    CONTROL("clSetKernelArg size", clSetKernelArg(kernel, 5, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg scratch", clSetKernelArg(kernel, 6, sizeof(float) * group_size, nullptr));
+    CONTROL("clSetKernelArg omega", clSetKernelArg(kernel, 8, sizeof(float), &omega));
+
+    kernel_time = 0;
+    std::vector<cl_event> evts;
+    float accuracy = 0.0;
+    int iters = 0;
+    const cl_int zero = 0;
+
+    time.first = std::chrono::high_resolution_clock::now();
+    while (true) {
+        // Red rows: x0 -> x1, black rows: x1 -> x0, so the sweep ends in x0
+        CONTROL("clEnqueueFillBuffer NORM", clEnqueueFillBuffer(session.queue, norm_buffer, &zero, sizeof(cl_int), 0, sizeof(cl_int), 0, nullptr, nullptr));
+        for (unsigned int color = 0; color < 2; color++) {
+            DeviceArray<float>& src = color == 0 ? x0 : x1;
+            DeviceArray<float>& dst = color == 0 ? x1 : x0;
+            CONTROL("clSetKernelArg X_SRC", clSetKernelArg(kernel, 2, sizeof(cl_mem), &src.read()));
+            CONTROL("clSetKernelArg X_DST", clSetKernelArg(kernel, 3, sizeof(cl_mem), &dst.write()));
+            CONTROL("clSetKernelArg color", clSetKernelArg(kernel, 7, sizeof(unsigned int), &color));
+            enqueueKernel(session, kernel, size, group_size, evts);
+        }
+        accuracy = readNorm(session, norm_buffer);
+        collectKernelTime(evts, kernel_time);
+        iters++;
+
+        if (accuracy < EPS || iters >= MAX_ITERS)
+            break;
+    }
+
+    // The solution is always returned in x1
+    CONTROL("clEnqueueCopyBuffer", clEnqueueCopyBuffer(session.queue, x0.read(), x1.write(), 0, 0, sizeof(float) * size, 0, nullptr, nullptr));
+    CONTROL("clFinish", clFinish(session.queue));
+    time.second = std::chrono::high_resolution_clock::now();
+    printConvergence(accuracy, iters);
+
+    clReleaseMemObject(norm_buffer);
+    clReleaseKernel(kernel);
+    return iters;
+}
+
+// All the methods but plain CG divide by the diagonal, a zero there would only show up as inf in x
+static void checkDiagonal(const float* a, int size, const std::string& section) {
+    for (int i = 0; i < size; i++) {
+        if (a[static_cast<size_t>(i) * size + i] == 0.0f) {
+            THROW_EXCEPTION(section, "zero diagonal in row " + std::to_string(i))
+        }
+    }
+}
+
+static int solve(SolverMethod method, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0,
+    DeviceArray<float>& x1, int size, Session& session, timer& time, cl_ulong& kernel_time, const float omega) {
+    switch (method) {
+    case SOLVER_JACOBI:
+        return jacobi_cl(a, b, x0, x1, size, session, time, kernel_time);
+    case SOLVER_CG:
+    case SOLVER_PCG:
+        return conjugateGradient(method == SOLVER_PCG, a, b, x0, x1, size, session, time, kernel_time);
+    case SOLVER_GAUSS_SEIDEL:
+        return redBlackSor(1.0f, a, b, x0, x1, size, session, time, kernel_time);
+    case SOLVER_SOR:
+        return redBlackSor(omega, a, b, x0, x1, size, session, time, kernel_time);
+    default:
+        THROW_EXCEPTION(std::string("solve_cl"), "unknown solver")
+    }
+}
+
+int solve_cl(SolverMethod method, DeviceArray<float>& a, DeviceArray<float>& b, DeviceArray<float>& x0,
+    DeviceArray<float>& x1, int size, Session& session, timer& time, cl_ulong& kernel_time, const float omega) {
+    if (method != SOLVER_CG)
+        checkDiagonal(a.host(), size, "solve_cl");
+    return solve(method, a, b, x0, x1, size, session, time, kernel_time, omega);
+}
+
+int solve_cl(SolverMethod method, float* a, float* b, float* x0, float* x1, int size,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time, const float omega) {
+    Session session(dev_pair);
+    DeviceArray<float> a_array(session, a, size * size);
+    DeviceArray<float> b_array(session, b, size);
+    DeviceArray<float> x0_array(session, x0, size);
+    DeviceArray<float> x1_array(session, x1, size);
+
+    const int iters = solve_cl(method, a_array, b_array, x0_array, x1_array, size, session, time, kernel_time, omega);
+    x1_array.host();
+    return iters;
+}
+
+static bool supportsDouble(cl_device_id device) {
+    size_t length = 0;
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, nullptr, &length);
+    std::string extensions(length, '\0');
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, length, &extensions[0], nullptr);
+    return extensions.find("cl_khr_fp64") != std::string::npos;
+}
+
+int refine_cl(SolverMethod inner, RefineStorage storage, const float* a, const double* b, double* x, int size,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time) {
+    if (storage == REFINE_FP16 && inner != SOLVER_JACOBI) {
+        THROW_EXCEPTION(std::string("refine_cl"), "fp16 storage of A is supported by the Jacobi inner solver only")
+    }
+    // The host residual divides by the diagonal as well, so it's checked whatever the inner solver is
+    checkDiagonal(a, size, "refine_cl");
+
+    cl_int error = CL_SUCCESS;
+    Session session(dev_pair);
+    DeviceArray<float> a_array(session, const_cast<float*>(a), size * size);
+    // The inner system A d = r: r, the initial guess and the correction
+    DeviceArray<float> r_array(session, size);
+    DeviceArray<float> d0_array(session, size);
+    DeviceArray<float> d1_array(session, size);
+    const bool device_fp64 = supportsDouble(session.device);
+
+    cl_kernel residual = nullptr, update = nullptr;
+    cl_mem b_buffer = nullptr, x_buffer = nullptr, norm_buffer = nullptr;
+    size_t group_size = 0;
+    if (device_fp64) {
+        cl_program program = session.getProgram("kernels/refine_kernel.cl");
+        residual = clCreateKernel(program, "residual_fp64", &error);
+        CONTROL("clCreateKernel residual_fp64", error);
+        update = clCreateKernel(program, "update_fp64", &error);
+        CONTROL("clCreateKernel update_fp64", error);
+        group_size = reductionGroupSize(session, { residual });
+
+        b_buffer = clCreateBuffer(session.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(double) * size, const_cast<double*>(b), &error);
+        CONTROL("clCreateBuffer B", error);
+        x_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(double) * size, x, &error);
+        CONTROL("clCreateBuffer X", error);
+        norm_buffer = clCreateBuffer(session.context, CL_MEM_READ_WRITE, sizeof(cl_int), nullptr, &error);
+        CONTROL("clCreateBuffer NORM", error);
+
+        CONTROL("clSetKernelArg A", clSetKernelArg(residual, 0, sizeof(cl_mem), &a_array.read()));
+        CONTROL("clSetKernelArg B", clSetKernelArg(residual, 1, sizeof(cl_mem), &b_buffer));
+        CONTROL("clSetKernelArg X", clSetKernelArg(residual, 2, sizeof(cl_mem), &x_buffer));
+        CONTROL("clSetKernelArg NORM", clSetKernelArg(residual, 5, sizeof(cl_mem), &norm_buffer));
+        CONTROL("clSetKernelArg size", clSetKernelArg(residual, 6, sizeof(unsigned int), &size));
+        CONTROL("clSetKernelArg scratch", clSetKernelArg(residual, 7, sizeof(float) * group_size, nullptr));
+        CONTROL("clSetKernelArg X", clSetKernelArg(update, 0, sizeof(cl_mem), &x_buffer));
+        CONTROL("clSetKernelArg size", clSetKernelArg(update, 2, sizeof(unsigned int), &size));
+    }
+    cl_mem a_half = (storage == REFINE_FP16) ? createHalfMatrix(a_array, size, session) : nullptr;
+
+    kernel_time = 0;
+    std::vector<cl_event> evts;
+    const cl_int zero = 0;
+    double accuracy = 0.0;
+    int outer_iters = 0, inner_iters = 0;
+    timer inner_time;
+    cl_ulong inner_kernel_time = 0;
+
+    time.first = std::chrono::high_resolution_clock::now();
+    while (true) {
+        if (device_fp64) {
+            CONTROL("clEnqueueFillBuffer NORM", clEnqueueFillBuffer(session.queue, norm_buffer, &zero, sizeof(cl_int), 0, sizeof(cl_int), 0, nullptr, nullptr));
+            CONTROL("clSetKernelArg R", clSetKernelArg(residual, 3, sizeof(cl_mem), &r_array.write()));
+            CONTROL("clSetKernelArg GUESS", clSetKernelArg(residual, 4, sizeof(cl_mem), &d0_array.write()));
+            enqueueKernel(session, residual, size, group_size, evts);
+            accuracy = readNorm(session, norm_buffer);
+            collectKernelTime(evts, kernel_time);
+        } else {
+            float* r = r_array.host();
+            float* d0 = d0_array.host();
+            accuracy = 0.0;
+            for (int i = 0; i < size; i++) {
+                double sum = 0.0;
+                for (int j = 0; j < size; j++)
+                    sum += static_cast<double>(a[static_cast<size_t>(j) * size + i]) * x[j];
+                const double res = b[i] - sum;
+                r[i] = static_cast<float>(res);
+                d0[i] = static_cast<float>(res / a[static_cast<size_t>(i) * size + i]);
+                accuracy = std::max(accuracy, std::fabs(res / b[i]));
+            }
+            r_array.hostModified();
+            d0_array.hostModified();
+        }
+        if (accuracy < REFINE_EPS || outer_iters >= REFINE_MAX_ITERS)
+            break;
+
+        // The correction in float: half or a quarter of the bytes of a double sweep
+        if (a_half != nullptr)
+            inner_iters += jacobi_half_cl(a_half, r_array, d0_array, d1_array, size, session, inner_time, inner_kernel_time);
+        else
+            inner_iters += solve(inner, a_array, r_array, d0_array, d1_array, size, session, inner_time, inner_kernel_time, SOR_OMEGA);
+        kernel_time += inner_kernel_time;
+
+        if (device_fp64) {
+            CONTROL("clSetKernelArg D", clSetKernelArg(update, 1, sizeof(cl_mem), &d1_array.read()));
+            enqueueKernel(session, update, size, group_size, evts);
+        } else {
+            const float* d = d1_array.host();
+            for (int i = 0; i < size; i++)
+                x[i] += d[i];
+        }
+        outer_iters++;
+    }
+    if (device_fp64)
+        CONTROL("clEnqueueReadBuffer X", clEnqueueReadBuffer(session.queue, x_buffer, CL_TRUE, 0, sizeof(double) * size, x, 0, nullptr, nullptr));
+    collectKernelTime(evts, kernel_time);
+    time.second = std::chrono::high_resolution_clock::now();
+
+    if (accuracy < REFINE_EPS)
+        std::cout << "[ INFO ] Refinement accuracy (" << accuracy << ") is achieved (outer iters: " << outer_iters <<
+            ", inner iters: " << inner_iters << ", residuals on the " << (device_fp64 ? "device" : "host") << ")" << std::endl;
+    else
+        std::cout << "[ INFO ] Refinement accuracy isn't achieved (" << accuracy << "), count of outer iterations is exceeded" << std::endl;
+
+    if (a_half != nullptr)
+        clReleaseMemObject(a_half);
+    if (device_fp64) {
+        clReleaseMemObject(norm_buffer);
+        clReleaseMemObject(x_buffer);
+        clReleaseMemObject(b_buffer);
+        clReleaseKernel(update);
+        clReleaseKernel(residual);
+    }
+    return outer_iters;
+}
@@ -0,0 +1,383 @@
+#include "../include/sparse.h"
+
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+CsrMatrix csrFromDense(const float* a, int size) {
+    CsrMatrix csr;
+    csr.size = size;
+    csr.row_ptr.reserve(size + 1);
+    csr.row_ptr.push_back(0);
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            const float value = a[static_cast<size_t>(j) * size + i];
+            if (value != 0.0f) {
+                csr.col_idx.push_back(j);
+                csr.values.push_back(value);
+            }
+        }
+        csr.row_ptr.push_back(static_cast<int>(csr.values.size()));
+    }
+    return csr;
+}
+
+CsrMatrix csrFromCoo(int size, const std::vector<int>& rows, const std::vector<int>& cols, const std::vector<float>& values) {
+    if (rows.size() != cols.size() || rows.size() != values.size()) {
+        THROW_EXCEPTION(std::string("csrFromCoo"), "sizes of the COO arrays differ")
+    }
+
+    std::vector<size_t> order(rows.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t l, size_t r) {
+        return rows[l] != rows[r] ? rows[l] < rows[r] : cols[l] < cols[r];
+    });
+
+    CsrMatrix csr;
+    csr.size = size;
+    csr.row_ptr.assign(size + 1, 0);
+    for (size_t k = 0; k < order.size(); k++) {
+        const size_t e = order[k];
+        if (rows[e] < 0 || rows[e] >= size || cols[e] < 0 || cols[e] >= size) {
+            THROW_EXCEPTION(std::string("csrFromCoo"), "entry out of the matrix")
+        }
+        if (k > 0 && rows[e] == rows[order[k - 1]] && cols[e] == cols[order[k - 1]]) {
+            csr.values.back() += values[e];
+            continue;
+        }
+        csr.col_idx.push_back(cols[e]);
+        csr.values.push_back(values[e]);
+        csr.row_ptr[rows[e] + 1]++;
+    }
+    for (int i = 0; i < size; i++)
+        csr.row_ptr[i + 1] += csr.row_ptr[i];
+    return csr;
+}
+
+EllMatrix ellFromCsr(const CsrMatrix& csr) {
+    EllMatrix ell;
+    ell.size = csr.size;
+    for (int i = 0; i < csr.size; i++)
+        ell.width = std::max(ell.width, csr.row_ptr[i + 1] - csr.row_ptr[i]);
+
+    ell.col_idx.assign(static_cast<size_t>(ell.width) * ell.size, 0);
+    ell.values.assign(static_cast<size_t>(ell.width) * ell.size, 0.0f);
+    for (int i = 0; i < csr.size; i++) {
+        for (int k = csr.row_ptr[i]; k < csr.row_ptr[i + 1]; k++) {
+            const size_t idx = static_cast<size_t>(k - csr.row_ptr[i]) * ell.size + i;
+            ell.col_idx[idx] = csr.col_idx[k];
+            ell.values[idx] = csr.values[k];
+        }
+    }
+    return ell;
+}
+
+SellMatrix sellFromCsr(const CsrMatrix& csr, int chunk, int sigma) {
+    SellMatrix sell;
+    sell.size = csr.size;
+    sell.chunk = chunk;
+    sell.sigma = sigma;
+
+    auto length = [&](int row) { return csr.row_ptr[row + 1] - csr.row_ptr[row]; };
+
+    // Sorting inside the sigma-windows groups rows of similar length into the same slice
+    std::vector<int> order(csr.size);
+    std::iota(order.begin(), order.end(), 0);
+    for (int w = 0; w < csr.size; w += sigma) {
+        std::stable_sort(order.begin() + w, order.begin() + std::min(w + sigma, csr.size),
+            [&](int l, int r) { return length(l) > length(r); });
+    }
+
+    const int slices = (csr.size + chunk - 1) / chunk;
+    sell.perm.assign(static_cast<size_t>(slices) * chunk, -1);
+    std::copy(order.begin(), order.end(), sell.perm.begin());
+
+    sell.slice_ptr.assign(slices + 1, 0);
+    for (int s = 0; s < slices; s++) {
+        int width = 0;
+        for (int lane = 0; lane < chunk; lane++) {
+            const int row = sell.perm[s * chunk + lane];
+            if (row >= 0)
+                width = std::max(width, length(row));
+        }
+        sell.slice_ptr[s + 1] = sell.slice_ptr[s] + width * chunk;
+    }
+
+    sell.col_idx.assign(sell.slice_ptr.back(), 0);
+    sell.values.assign(sell.slice_ptr.back(), 0.0f);
+    for (int s = 0; s < slices; s++) {
+        for (int lane = 0; lane < chunk; lane++) {
+            const int row = sell.perm[s * chunk + lane];
+            if (row < 0)
+                continue;
+            for (int k = csr.row_ptr[row]; k < csr.row_ptr[row + 1]; k++) {
+                const int idx = sell.slice_ptr[s] + (k - csr.row_ptr[row]) * chunk + lane;
+                sell.col_idx[idx] = csr.col_idx[k];
+                sell.values[idx] = csr.values[k];
+            }
+        }
+    }
+    return sell;
+}
+
+CsrMatrix generatePoissonMatrix(int grid, float shift) {
+    std::vector<int> rows, cols;
+    std::vector<float> values;
+    auto add = [&](int row, int col, float value) {
+        rows.push_back(row);
+        cols.push_back(col);
+        values.push_back(value);
+    };
+
+    for (int r = 0; r < grid; r++) {
+        for (int c = 0; c < grid; c++) {
+            const int row = r * grid + c;
+            add(row, row, 4.0f + shift);
+            if (r > 0)
+                add(row, row - grid, -1.0f);
+            if (r < grid - 1)
+                add(row, row + grid, -1.0f);
+            if (c > 0)
+                add(row, row - 1, -1.0f);
+            if (c < grid - 1)
+                add(row, row + 1, -1.0f);
+        }
+    }
+    return csrFromCoo(grid * grid, rows, cols, values);
+}
+
+// ------------------------------------------------------------------------------------
+// Device copy of a sparse matrix in one of the formats
+
+template <typename T>
+static cl_mem createBuffer(Session& session, const std::vector<T>& data) {
+    cl_int error = CL_SUCCESS;
+    // Empty matrices still get a valid buffer
+    std::vector<T> one(1);
+    const std::vector<T>& src = data.empty() ? one : data;
+    cl_mem buffer = clCreateBuffer(session.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        sizeof(T) * src.size(), const_cast<T*>(src.data()), &error);
+    CONTROL("clCreateBuffer", error);
+    return buffer;
+}
+
+struct DeviceSparseMatrix {
+    std::vector<cl_mem> buffers;
+    cl_mem values = nullptr, col_idx = nullptr, row_ptr = nullptr, slice_ptr = nullptr, perm = nullptr;
+    unsigned int width = 0, chunk = 0, slots = 0;
+    // Rows for CSR scalar and ELL, rows * SPMV_VECTOR for CSR vector, slots for SELL
+    size_t work_items = 0;
+
+    ~DeviceSparseMatrix() {
+        for (cl_mem buffer : buffers)
+            clReleaseMemObject(buffer);
+    }
+};
+
+static void uploadSparse(Session& session, const CsrMatrix& a, SparseFormat format, DeviceSparseMatrix& m) {
+    auto add = [&](cl_mem buffer) {
+        m.buffers.push_back(buffer);
+        return buffer;
+    };
+
+    switch (format) {
+    case SPARSE_CSR_SCALAR:
+    case SPARSE_CSR_VECTOR:
+        m.values = add(createBuffer(session, a.values));
+        m.col_idx = add(createBuffer(session, a.col_idx));
+        m.row_ptr = add(createBuffer(session, a.row_ptr));
+        m.work_items = static_cast<size_t>(a.size) * (format == SPARSE_CSR_VECTOR ? SPMV_VECTOR : 1);
+        break;
+    case SPARSE_ELL: {
+        const EllMatrix ell = ellFromCsr(a);
+        m.values = add(createBuffer(session, ell.values));
+        m.col_idx = add(createBuffer(session, ell.col_idx));
+        m.width = ell.width;
+        m.work_items = a.size;
+        break;
+    }
+    case SPARSE_SELL: {
+        const SellMatrix sell = sellFromCsr(a);
+        m.values = add(createBuffer(session, sell.values));
+        m.col_idx = add(createBuffer(session, sell.col_idx));
+        m.slice_ptr = add(createBuffer(session, sell.slice_ptr));
+        m.perm = add(createBuffer(session, sell.perm));
+        m.chunk = sell.chunk;
+        m.slots = static_cast<unsigned int>(sell.perm.size());
+        m.work_items = m.slots;
+        break;
+    }
+    default:
+        THROW_EXCEPTION(std::string("uploadSparse"), "unknown sparse format")
+    }
+}
+
+// Kernel of the format and its work-group size: a power of 2 (the tree reductions need it) within the limit of
+// the device. The CSR vector kernels need SPMV_VECTOR work-items per row, if they don't fit a work-group
+// the format falls back to CSR scalar
+static cl_kernel createSparseKernel(cl_program program, Session& session, const char* const names[], SparseFormat& format,
+    size_t& group_size) {
+    cl_int error = CL_SUCCESS;
+    cl_kernel kernel = clCreateKernel(program, names[format], &error);
+    CONTROL("clCreateKernel", error);
+
+    group_size = 0;
+    CONTROL("clGetKernelWorkGroupInfo", clGetKernelWorkGroupInfo(kernel, session.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &group_size, nullptr));
+    while ((group_size & (group_size - 1)) != 0)
+        group_size &= group_size - 1;
+    if (format == SPARSE_CSR_VECTOR && group_size < SPMV_VECTOR) {
+        std::cout << "[ INFO ] " << SPMV_VECTOR << " work-items per row don't fit a work-group, CSR scalar is used" << std::endl;
+        clReleaseKernel(kernel);
+        format = SPARSE_CSR_SCALAR;
+        return createSparseKernel(program, session, names, format, group_size);
+    }
+    return kernel;
+}
+
+static const char* sparseProgramOptions() {
+    static const std::string options = "-DSPMV_VECTOR=" + std::to_string(SPMV_VECTOR);
+    return options.c_str();
+}
+
+void spmv_cl(const CsrMatrix& a, const float* x, float* y, SparseFormat format,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time) {
+    Session session(dev_pair);
+    DeviceArray<float> x_array(session, const_cast<float*>(x), a.size);
+    DeviceArray<float> y_array(session, y, a.size);
+
+    spmv_cl(a, x_array, y_array, format, session, time);
+    y_array.host();
+}
+
+void spmv_cl(const CsrMatrix& a, DeviceArray<float>& x, DeviceArray<float>& y, SparseFormat format,
+    Session& session, timer& time) {
+    cl_program program = session.getProgram("kernels/sparse_kernel.cl", sparseProgramOptions());
+
+    const char* names[] = { "spmv_csr_scalar", "spmv_csr_vector", "spmv_ell", "spmv_sell" };
+    size_t group_size = 0;
+    cl_kernel kernel = createSparseKernel(program, session, names, format, group_size);
+
+    DeviceSparseMatrix m;
+    uploadSparse(session, a, format, m);
+
+    const size_t global_size = (m.work_items + group_size - 1) / group_size * group_size;
+    const unsigned int size = a.size;
+
+    switch (format) {
+    case SPARSE_CSR_SCALAR:
+    case SPARSE_CSR_VECTOR:
+        CONTROL("clSetKernelArg row_ptr", clSetKernelArg(kernel, 0, sizeof(cl_mem), &m.row_ptr));
+        CONTROL("clSetKernelArg col_idx", clSetKernelArg(kernel, 1, sizeof(cl_mem), &m.col_idx));
+        CONTROL("clSetKernelArg values", clSetKernelArg(kernel, 2, sizeof(cl_mem), &m.values));
+        CONTROL("clSetKernelArg x", clSetKernelArg(kernel, 3, sizeof(cl_mem), &x.read()));
+        CONTROL("clSetKernelArg y", clSetKernelArg(kernel, 4, sizeof(cl_mem), &y.write()));
+        CONTROL("clSetKernelArg size", clSetKernelArg(kernel, 5, sizeof(unsigned int), &size));
+        if (format == SPARSE_CSR_VECTOR)
+            CONTROL("clSetKernelArg partial", clSetKernelArg(kernel, 6, sizeof(float) * group_size, nullptr));
+        break;
+    case SPARSE_ELL:
+        CONTROL("clSetKernelArg col_idx", clSetKernelArg(kernel, 0, sizeof(cl_mem), &m.col_idx));
+        CONTROL("clSetKernelArg values", clSetKernelArg(kernel, 1, sizeof(cl_mem), &m.values));
+        CONTROL("clSetKernelArg width", clSetKernelArg(kernel, 2, sizeof(unsigned int), &m.width));
+        CONTROL("clSetKernelArg x", clSetKernelArg(kernel, 3, sizeof(cl_mem), &x.read()));
+        CONTROL("clSetKernelArg y", clSetKernelArg(kernel, 4, sizeof(cl_mem), &y.write()));
+        CONTROL("clSetKernelArg size", clSetKernelArg(kernel, 5, sizeof(unsigned int), &size));
+        break;
+    case SPARSE_SELL:
+        CONTROL("clSetKernelArg slice_ptr", clSetKernelArg(kernel, 0, sizeof(cl_mem), &m.slice_ptr));
+        CONTROL("clSetKernelArg col_idx", clSetKernelArg(kernel, 1, sizeof(cl_mem), &m.col_idx));
+        CONTROL("clSetKernelArg values", clSetKernelArg(kernel, 2, sizeof(cl_mem), &m.values));
+        CONTROL("clSetKernelArg perm", clSetKernelArg(kernel, 3, sizeof(cl_mem), &m.perm));
+        CONTROL("clSetKernelArg chunk", clSetKernelArg(kernel, 4, sizeof(unsigned int), &m.chunk));
+        CONTROL("clSetKernelArg x", clSetKernelArg(kernel, 5, sizeof(cl_mem), &x.read()));
+        CONTROL("clSetKernelArg y", clSetKernelArg(kernel, 6, sizeof(cl_mem), &y.write()));
+        CONTROL("clSetKernelArg slots", clSetKernelArg(kernel, 7, sizeof(unsigned int), &m.slots));
+        break;
+    }
+
+    time.first = std::chrono::high_resolution_clock::now();
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(session.queue, kernel, 1, nullptr, &global_size, &group_size, 0, nullptr, nullptr));
+    CONTROL("clFinish", clFinish(session.queue));
+    time.second = std::chrono::high_resolution_clock::now();
+
+    clReleaseKernel(kernel);
+}
+
+void jacobi_sparse_cl(const CsrMatrix& a, float* b, float* x0, float* x1, SparseFormat format,
+    std::pair<cl_platform_id, cl_device_id>& dev_pair, timer& time, cl_ulong& kernel_time, const int batch) {
+    Session session(dev_pair);
+    DeviceArray<float> b_array(session, b, a.size);
+    DeviceArray<float> x0_array(session, x0, a.size);
+    DeviceArray<float> x1_array(session, x1, a.size);
+
+    jacobi_sparse_cl(a, b_array, x0_array, x1_array, format, session, time, kernel_time, batch);
+    x1_array.host();
+}
+
+int jacobi_sparse_cl(const CsrMatrix& a, DeviceArray<float>& b, DeviceArray<float>& x0, DeviceArray<float>& x1, SparseFormat format,
+    Session& session, timer& time, cl_ulong& kernel_time, const int batch) {
+    cl_program program = session.getProgram("kernels/sparse_kernel.cl", sparseProgramOptions());
+
+    const char* names[] = { "jacobi_csr_scalar", "jacobi_csr_vector", "jacobi_ell", "jacobi_sell" };
+    size_t group_size = 0;
+    cl_kernel kernel = createSparseKernel(program, session, names, format, group_size);
+
+    // The sweeps update the whole row: x1 = x0 + (b - A * x0) / diag
+    std::vector<float> inv_diag(a.size, 0.0f);
+    for (int i = 0; i < a.size; i++) {
+        for (int k = a.row_ptr[i]; k < a.row_ptr[i + 1]; k++) {
+            if (a.col_idx[k] == i)
+                inv_diag[i] += a.values[k];
+        }
+        if (inv_diag[i] == 0.0f) {
+            clReleaseKernel(kernel);
+            THROW_EXCEPTION(std::string("jacobi_sparse_cl"), "zero diagonal in row " + std::to_string(i))
+        }
+        inv_diag[i] = 1.0f / inv_diag[i];
+    }
+
+    DeviceSparseMatrix m;
+    uploadSparse(session, a, format, m);
+    m.buffers.push_back(createBuffer(session, inv_diag));
+    cl_mem inv_diag_buffer = m.buffers.back();
+
+    const size_t global_size = (m.work_items + group_size - 1) / group_size * group_size;
+    const unsigned int size = a.size;
+
+    CONTROL("clSetKernelArg values", clSetKernelArg(kernel, 0, sizeof(cl_mem), &m.values));
+    CONTROL("clSetKernelArg B", clSetKernelArg(kernel, 1, sizeof(cl_mem), &b.read()));
+    CONTROL("clSetKernelArg size", clSetKernelArg(kernel, 5, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg scratch", clSetKernelArg(kernel, 6, sizeof(float) * group_size, nullptr));
+    CONTROL("clSetKernelArg inv_diag", clSetKernelArg(kernel, 8, sizeof(cl_mem), &inv_diag_buffer));
+    CONTROL("clSetKernelArg col_idx", clSetKernelArg(kernel, 9, sizeof(cl_mem), &m.col_idx));
+    switch (format) {
+    case SPARSE_CSR_SCALAR:
+    case SPARSE_CSR_VECTOR:
+        CONTROL("clSetKernelArg row_ptr", clSetKernelArg(kernel, 10, sizeof(cl_mem), &m.row_ptr));
+        break;
+    case SPARSE_ELL:
+        CONTROL("clSetKernelArg width", clSetKernelArg(kernel, 10, sizeof(unsigned int), &m.width));
+        break;
+    case SPARSE_SELL:
+        CONTROL("clSetKernelArg slice_ptr", clSetKernelArg(kernel, 10, sizeof(cl_mem), &m.slice_ptr));
+        CONTROL("clSetKernelArg perm", clSetKernelArg(kernel, 11, sizeof(cl_mem), &m.perm));
+        CONTROL("clSetKernelArg chunk", clSetKernelArg(kernel, 12, sizeof(unsigned int), &m.chunk));
+        CONTROL("clSetKernelArg slots", clSetKernelArg(kernel, 13, sizeof(unsigned int), &m.slots));
+        break;
+    }
+
+    time.first = std::chrono::high_resolution_clock::now();
+    const int iters = jacobiSweeps(session, kernel, global_size, group_size, x0, x1, a.size, batch, time, kernel_time);
+
+    clReleaseKernel(kernel);
+    return iters;
+}
+
+void checkSolutionOfSparseSOLE(const CsrMatrix& a, const float* b, const float* x, const float eps) {
+    std::vector<double> actual(a.size, 0);
+    for (int i = 0; i < a.size; i++) {
+        for (int k = a.row_ptr[i]; k < a.row_ptr[i + 1]; k++)
+            actual[i] += static_cast<double>(a.values[k]) * x[a.col_idx[k]];
+    }
+    checkResidualOfSOLE(actual, b, eps);
+}
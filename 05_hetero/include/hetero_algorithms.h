@@ -5,19 +5,68 @@
 #define BLOCK 16
 #define MAX_ITERS 50000
 #define EPS  1e-5
+#define CALIBRATION_ITERS 10 // iterations of the Jacobi probe when the split isn't calibrated yet
+#define HOST_CORES 1        // compute units of the CPU device left to the host threads
+#define HETERO_SHARED_CONTEXT 1  // one context for the devices of one platform in the partitioned Jacobi
+#define GEMM_PANEL 64       // rows of A and C streamed at once by the static GEMM, a multiple of BLOCK
+#define GEMM_TILE 16        // rows of the smallest tile of the dynamic GEMM, a multiple of BLOCK
+#define ASYNC_SWEEPS 4      // local sweeps between two exchanges of the asynchronous Jacobi
+#define ASYNC_STALENESS 2   // max exchanges a device may run ahead of the slowest one
+#define ASYNC_BLOCK 64      // rows frozen together once converged
 
 #include <vector>
 #include "CL/cl.h"
 #include "utils.h"
 
+// A device of the N-device engines: rows are split proportionally to the weights
+struct HeteroDevice {
+	std::pair<cl_platform_id, cl_device_id> dev_pair;
+	double weight;
+};
+
+// Weights the devices by compute units * max clock frequency as the first guess
+std::vector<HeteroDevice> heteroDevices(const std::vector<std::pair<cl_platform_id, cl_device_id>>& dev_pairs);
+// Splits a CPU device into one sub-device per NUMA node (the whole device if it can't be split so),
+// `reserved` compute units of the first node are left to the host threads (none if the runtime can't partition
+// by counts). Every sub-device created on the way, the returned ones and the node a reservation was carved from,
+// is appended to `created`: release them with clReleaseDevice
+std::vector<std::pair<cl_platform_id, cl_device_id>> cpuSubDevices(std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair,
+	std::vector<cl_device_id>& created, const cl_uint reserved = HOST_CORES);
+
 void matmul(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c);
+// Static split: the GPU computes the first gpu_m rows, the CPU the rest, A and C are streamed in panels
 void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
 	std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair,
 	timer& time, const size_t gpu_m);
+// Dynamic split: the host thread of every device pulls tiles of rows from a shared queue while its device is free,
+// the first chunks are sized by the calibration cache (see split_cache.h)
+void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+	std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair,
+	timer& time);
+// Dynamic split over any list of devices, the weights size the first chunks
+void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+	std::vector<HeteroDevice>& devices, timer& time);
 
-void jacobi_cl(float* a, float* b, float* x0, float* x1, float* norm, int size,
+// Static split: the GPU solves the first gpu_m rows, the CPU the rest. Each device holds only its rows of A
+// and exchanges only its slice of x per sweep. The solution is written to x1
+void jacobi_cl(const float* a, const float* b, const float* x0, float* x1, int size,
 	std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time,
 	cl_ulong& kernel_time, const int gpu_m);
+// The split is taken from the calibration cache (see split_cache.h), a short probe calibrates it on the first call
+void jacobi_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+	std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time,
+	cl_ulong& kernel_time);
+// Static split over any list of devices by their weights
+void jacobi_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+	std::vector<HeteroDevice>& devices, timer& time, cl_ulong& kernel_time);
+
+// Asynchronous (chaotic) relaxation: every device iterates its rows on the latest available rows of the other one
+// and freezes converged blocks, a final synchronous sweep verifies the result. The solution is written to x1
+void jacobi_async_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+	std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time,
+	cl_ulong& kernel_time, const int gpu_m, const int staleness = ASYNC_STALENESS);
+void jacobi_async_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+	std::vector<HeteroDevice>& devices, timer& time, cl_ulong& kernel_time, const int staleness = ASYNC_STALENESS);
 
 
 #endif // _GPU_HETERO_ALGORITHM_H_
@@ -0,0 +1,27 @@
+#ifndef _GPU_SPLIT_CACHE_H_
+#define _GPU_SPLIT_CACHE_H_
+
+#define SPLIT_CACHE_FILE "split_cache.txt"
+#define SPLIT_HISTORY 8     // weight of the cached share against a new observation
+
+#include <string>
+#include "CL/cl.h"
+#include "utils.h"
+
+enum HeteroAlgorithm {
+	HETERO_GEMM,
+	HETERO_JACOBI
+};
+
+// GPU share of the rows per (GPU, CPU, algorithm, shape class), the shape class is log2 of the work.
+// The cache lives in SPLIT_CACHE_FILE, so it survives between runs
+bool lookupSplit(std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair,
+	HeteroAlgorithm algorithm, const double work, double& gpu_share);
+
+// Refines the cached share from an observed run: gpu_rows and cpu_rows were processed in gpu_seconds
+// and cpu_seconds (kernels and transfers), the best share makes both devices finish together
+void updateSplit(std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair,
+	HeteroAlgorithm algorithm, const double work, const double gpu_rows, const double gpu_seconds,
+	const double cpu_rows, const double cpu_seconds);
+
+#endif // _GPU_SPLIT_CACHE_H_
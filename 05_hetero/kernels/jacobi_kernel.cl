@@ -1,15 +1,65 @@
-__kernel void jacobi(__global float *A, __global float *b, __global float *x0, 
-                     __global float *x1, __global float *norm, unsigned int size, unsigned int stride) {
-    const unsigned int ithr = get_global_id(0);
-    const unsigned int global_stride = stride + ithr;
-    if (global_stride >= size)
-        return;
+// Rows [first_row, first_row + rows) of the system: A and b hold only these rows, element (i, j) is
+// A[j * rows + i - first_row]. x0 is the full vector, x1 starts at the row x1_offset: the full vector (0)
+// or the own slice (first_row), only the own rows of x1 are computed.
+// The max of |x1 - x0| / |x0| over the rows is reduced into *norm (bits of a non-negative float)
+__kernel void jacobi(__global const float *A, __global const float *b, __global const float *x0,
+                     __global float *x1, __global int *norm, unsigned int size, unsigned int rows,
+                     unsigned int first_row, __local float *scratch, unsigned int x1_offset) {
+    const unsigned int lid = get_local_id(0);
+    const unsigned int i = get_global_id(0);
+    const unsigned int row = first_row + i;
 
-    float sum = .0f;
-    for (unsigned int j = 0; j < size; j++) {
-        sum += A[j * size + global_stride] * x0[j] * (float)(global_stride != j);
+    float change = .0f;
+    if (i < rows) {
+        float sum = .0f;
+        for (unsigned int j = 0; j < size; j++) {
+            sum += A[j * rows + i] * x0[j] * (float)(row != j);
+        }
+        const float x = (b[i] - sum) / A[row * rows + i];
+        x1[row - x1_offset] = x;
+        change = fabs((x - x0[row]) / x0[row]);
     }
 
-    x1[ithr] = (b[ithr] - sum) / A[global_stride * size + global_stride];
-    norm[ithr] = x1[ithr] - x0[global_stride];
+    scratch[lid] = change;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            scratch[lid] = fmax(scratch[lid], scratch[lid + s]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0)
+        atomic_max(norm, as_int(scratch[0]));
+}
+
+// Asynchronous relaxation: a work-group per active block of get_local_size(0) rows of the partition
+// [first_row, last_row), x0 and x1 are full vectors, b is the full right-hand side.
+// block_norm[block] - max |x1 - x0| / |x0| over the rows of the block; frozen blocks are not in `blocks`
+__kernel void jacobi_block(__global const float *A, __global const float *b, __global const float *x0,
+                           __global float *x1, __global float *block_norm, unsigned int size,
+                           unsigned int first_row, unsigned int last_row, __global const int *blocks,
+                           __local float *scratch) {
+    const unsigned int lid = get_local_id(0);
+    const unsigned int block = blocks[get_group_id(0)];
+    const unsigned int row = first_row + block * get_local_size(0) + lid;
+
+    float change = .0f;
+    if (row < last_row) {
+        float sum = .0f;
+        for (unsigned int j = 0; j < size; j++) {
+            sum += A[j * size + row] * x0[j] * (float)(row != j);
+        }
+        const float x = (b[row] - sum) / A[row * size + row];
+        x1[row] = x;
+        change = fabs((x - x0[row]) / x0[row]);
+    }
+
+    scratch[lid] = change;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (unsigned int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            scratch[lid] = fmax(scratch[lid], scratch[lid + s]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0)
+        block_norm[block] = scratch[0];
 }
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <chrono>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -79,6 +80,20 @@ int main(int argc, char** argv) {
                 std::cout << TIME_MS(time.first, time.second) << std::endl;
                 CHECK(FLAG_CHECK, float, c_ref, c, c_size);
             }
+
+            // DYNAMIC
+            {
+                timer time;
+                char cpu_name[128];
+                char gpu_name[128];
+                clGetDeviceInfo(cpus[0].second, CL_DEVICE_NAME, 128, cpu_name, nullptr);
+                clGetDeviceInfo(gpus[0].second, CL_DEVICE_NAME, 128, gpu_name, nullptr);
+                std::cout << "Time 'GPU' (device " << gpu_name << ") and 'CPU' (device " << cpu_name << "), dynamic tiles: ";
+                std::memset(c, 0, c_size * sizeof(float));
+                gemm_cl(M, N, K, a, b, c, cpus[0], gpus[0], time);
+                std::cout << TIME_MS(time.first, time.second) << std::endl;
+                CHECK(FLAG_CHECK, float, c_ref, c, c_size);
+            }
         }
         catch (Exception& exc) {
             std::cout << exc.what() << std::endl;
@@ -98,7 +113,6 @@ int main(int argc, char** argv) {
         float* b = new float[SIZE];
         float* x0 = new float[SIZE];
         float* x1 = new float[SIZE];
-        float* norm = new float[SIZE];
         float* tmp = new float[SIZE];
         cl_ulong kernel_time = 0;
         timer time;
@@ -112,7 +126,6 @@ int main(int argc, char** argv) {
         try {
             for (auto pers : percents) {
                 std::memcpy(x0, tmp, SIZE * sizeof(float));
-                std::memset(norm, 0, sizeof(float) * SIZE);
                 std::memset(x1, 0, sizeof(float) * SIZE);
 
                 timer time;
@@ -122,7 +135,136 @@ int main(int argc, char** argv) {
                 clGetDeviceInfo(cpus[0].second, CL_DEVICE_NAME, 128, cpu_name, nullptr);
                 clGetDeviceInfo(gpus[0].second, CL_DEVICE_NAME, 128, gpu_name, nullptr);
                 std::cout << "Time 'GPU' (device " << gpu_name << ") and 'CPU' (device " << cpu_name << "), GPU = " << pers << "%:\n";
-                jacobi_cl(a, b, x0, x1, norm, SIZE, cpus[0], gpus[0], time, kernel_time, gpu_m);
+                jacobi_cl(a, b, x0, x1, SIZE, cpus[0], gpus[0], time, kernel_time, gpu_m);
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1, EPS);
+                std::cout << std::endl;
+            }
+
+            // AUTO: the first run calibrates the split, the second one uses and refines it
+            for (int run = 0; run < 2; run++) {
+                std::memcpy(x0, tmp, SIZE * sizeof(float));
+                std::memset(x1, 0, sizeof(float) * SIZE);
+
+                timer time;
+                std::cout << "Time 'GPU' and 'CPU', calibrated split:\n";
+                jacobi_cl(a, b, x0, x1, SIZE, cpus[0], gpus[0], time, kernel_time);
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1, EPS);
+                std::cout << std::endl;
+            }
+        }
+        catch (Exception& exc) {
+            std::cout << exc.what() << std::endl;
+        }
+    }
+
+
+    //************************************************************************************
+    // TASK 3
+    //************************************************************************************
+    {
+        std::cout << "===========================" << std::endl
+            << "\tTASK 3 JACOBI (ASYNCHRONOUS)" << std::endl
+            << "===========================" << std::endl;
+        // SRC DATA
+        float* a = new float[SIZE * SIZE];
+        float* b = new float[SIZE];
+        float* x0 = new float[SIZE];
+        float* x1 = new float[SIZE];
+        cl_ulong kernel_time = 0;
+
+        // System of equations
+        generateSymmetricPositiveMatrix(a, SIZE);
+        generateVector(b, SIZE);
+        generateVector(x0, SIZE);
+
+        try {
+            for (auto pers : percents) {
+                std::memset(x1, 0, sizeof(float) * SIZE);
+
+                timer time;
+                const size_t gpu_m = SIZE * pers;
+                char cpu_name[128];
+                char gpu_name[128];
+                clGetDeviceInfo(cpus[0].second, CL_DEVICE_NAME, 128, cpu_name, nullptr);
+                clGetDeviceInfo(gpus[0].second, CL_DEVICE_NAME, 128, gpu_name, nullptr);
+                std::cout << "Time 'GPU' (device " << gpu_name << ") and 'CPU' (device " << cpu_name << "), GPU = " << pers << "%:\n";
+                jacobi_async_cl(a, b, x0, x1, SIZE, cpus[0], gpus[0], time, kernel_time, gpu_m);
+                std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
+                    "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
+                if (FLAG_CHECK)
+                    checkSolutionOfSOLE(SIZE, a, b, x1, EPS);
+                std::cout << std::endl;
+            }
+        }
+        catch (Exception& exc) {
+            std::cout << exc.what() << std::endl;
+        }
+    }
+
+
+    //************************************************************************************
+    // TASK 4
+    //************************************************************************************
+    {
+        std::cout << "===========================" << std::endl
+            << "\tTASK 4 ALL DEVICES" << std::endl
+            << "===========================" << std::endl;
+        std::vector<cl_device_id> sub_devices;
+        try {
+            // every CPU device is split by NUMA nodes, a core is left to the host threads
+            std::vector<std::pair<cl_platform_id, cl_device_id>> dev_pairs(gpus);
+            for (auto& cpu : cpus) {
+                auto parts = cpuSubDevices(cpu, sub_devices);
+                dev_pairs.insert(dev_pairs.end(), parts.begin(), parts.end());
+            }
+            for (auto& dev_pair : dev_pairs) {
+                char name[128];
+                cl_uint units = 0;
+                clGetDeviceInfo(dev_pair.second, CL_DEVICE_NAME, 128, name, nullptr);
+                clGetDeviceInfo(dev_pair.second, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &units, nullptr);
+                std::cout << "Device: " << name << " (compute units: " << units << ")" << std::endl;
+            }
+
+            std::vector<HeteroDevice> devices = heteroDevices(dev_pairs);
+
+            // GEMM
+            {
+                const size_t c_size = M * K;
+                float* a = new float[M * N];
+                float* b = new float[N * K];
+                float* c = new float[c_size];
+                float* c_ref = new float[c_size];
+                fillData<float>(a, M * N);
+                fillData<float>(b, N * K);
+                matmul(M, N, K, a, b, c_ref);
+
+                timer time;
+                std::cout << "Time GEMM, dynamic tiles: ";
+                gemm_cl(M, N, K, a, b, c, devices, time);
+                std::cout << TIME_MS(time.first, time.second) << std::endl;
+                CHECK(FLAG_CHECK, float, c_ref, c, c_size);
+            }
+
+            // JACOBI
+            {
+                float* a = new float[SIZE * SIZE];
+                float* b = new float[SIZE];
+                float* x0 = new float[SIZE];
+                float* x1 = new float[SIZE];
+                cl_ulong kernel_time = 0;
+                generateSymmetricPositiveMatrix(a, SIZE);
+                generateVector(b, SIZE);
+                generateVector(x0, SIZE);
+
+                timer time;
+                std::cout << "Time JACOBI, split by weights:\n";
+                jacobi_cl(a, b, x0, x1, SIZE, devices, time, kernel_time);
                 std::cout << "-- all actions: " << TIME_MS(time.first, time.second) << "\n" <<
                     "-- only kernel: " << kernel_time * 1e-06 << " ms" << std::endl;
                 if (FLAG_CHECK)
@@ -133,6 +275,8 @@ int main(int argc, char** argv) {
         catch (Exception& exc) {
             std::cout << exc.what() << std::endl;
         }
+        for (auto sub_device : sub_devices)
+            clReleaseDevice(sub_device);
     }
 
     return 0;
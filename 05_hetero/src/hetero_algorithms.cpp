@@ -1,4 +1,12 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 #include "..\include\hetero_algorithms.h"
+#include "..\include\split_cache.h"
 
 void matmul(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c) {
     std::memset(c, 0, n * k * sizeof(float));
@@ -12,294 +20,1074 @@ void matmul(const size_t m, const size_t n, const size_t k, const float* a, cons
     }
 }
 
-void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
-    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time, const size_t gpu_m) {
-    cl_int error = CL_SUCCESS;
-    cl_context_properties cpu_properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)cpu_dev_pair.first, 0 };
-    cl_context_properties gpu_properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)gpu_dev_pair.first, 0 };
+std::vector<HeteroDevice> heteroDevices(const std::vector<std::pair<cl_platform_id, cl_device_id>>& dev_pairs) {
+    std::vector<HeteroDevice> devices;
+    for (auto& dev_pair : dev_pairs) {
+        cl_uint compute_units = 0, frequency = 0;
+        CONTROL("clGetDeviceInfo", clGetDeviceInfo(dev_pair.second, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &compute_units, nullptr));
+        CONTROL("clGetDeviceInfo", clGetDeviceInfo(dev_pair.second, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &frequency, nullptr));
+        devices.push_back({ dev_pair, double(compute_units) * std::max<cl_uint>(frequency, 1) });
+    }
+    return devices;
+}
+
+std::vector<std::pair<cl_platform_id, cl_device_id>> cpuSubDevices(std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair,
+    std::vector<cl_device_id>& created, const cl_uint reserved) {
+    cl_device_affinity_domain domains = 0;
+    if (supportsPartition(cpu_dev_pair.second, CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN)) {
+        CONTROL("clGetDeviceInfo", clGetDeviceInfo(cpu_dev_pair.second, CL_DEVICE_PARTITION_AFFINITY_DOMAIN, sizeof(domains), &domains, nullptr));
+    }
+    std::vector<cl_device_id> nodes = { cpu_dev_pair.second };
+    if (domains & CL_DEVICE_AFFINITY_DOMAIN_NUMA) {
+        nodes = createSubDevicesByAffinity(cpu_dev_pair.second, CL_DEVICE_AFFINITY_DOMAIN_NUMA);
+        created.insert(created.end(), nodes.begin(), nodes.end());
+    }
+
+    cl_uint units = 0;
+    CONTROL("clGetDeviceInfo", clGetDeviceInfo(nodes.front(), CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &units, nullptr));
+    if (reserved > 0 && reserved < units) {
+        // the node itself stays in `created`, it's released along with its sub-device
+        cl_device_id node = reserveHostCores(nodes.front(), reserved);
+        if (node != nodes.front()) {
+            nodes.front() = node;
+            created.push_back(node);
+        }
+    }
+
+    std::vector<std::pair<cl_platform_id, cl_device_id>> sub_devices;
+    for (auto node : nodes)
+        sub_devices.push_back(std::make_pair(cpu_dev_pair.first, node));
+    return sub_devices;
+}
+
+// Bounds of the rows of every device proportional to its weight, each bound is a multiple of `multiple`
+static std::vector<size_t> splitRows(const std::vector<HeteroDevice>& devices, const size_t rows, const size_t multiple) {
+    double total = 0.0;
+    for (auto& d : devices)
+        total += d.weight;
+    std::vector<size_t> bounds(devices.size() + 1, 0);
+    double weight = 0.0;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        weight += devices[i].weight;
+        const size_t bound = static_cast<size_t>(rows * weight / total / multiple + 0.5) * multiple;
+        bounds[i + 1] = std::max(bounds[i], std::min(bound, rows));
+    }
+    bounds.back() = rows;
+    return bounds;
+}
+
+static std::string deviceName(const std::pair<cl_platform_id, cl_device_id>& dev_pair) {
+    char name[128] = { 0 };
+    clGetDeviceInfo(dev_pair.second, CL_DEVICE_NAME, sizeof(name), name, nullptr);
+    return name;
+}
+
+// Completion barrier of one step of several devices: the event callback of every device arrives
+// as soon as its commands are done, the host thread waits for all of them only once
+class CompletionBarrier {
+public:
+    void reset(const size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = count;
+        status = CL_SUCCESS;
+    }
+
+    void arrive(const cl_int event_status) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (event_status < 0)
+            status = event_status;
+        if (--pending == 0)
+            done.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return pending == 0; });
+        CONTROL("CompletionBarrier", status);
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t pending = 0;
+    cl_int status = CL_SUCCESS;
+};
+
+static void CL_CALLBACK arriveAtBarrier(cl_event, cl_int event_status, void* user_data) {
+    static_cast<CompletionBarrier*>(user_data)->arrive(event_status);
+}
+
+// Calls barrier.arrive when evt completes and releases evt
+static void arriveOnComplete(cl_event evt, CompletionBarrier& barrier) {
+    CONTROL("clSetEventCallback", clSetEventCallback(evt, CL_COMPLETE, arriveAtBarrier, &barrier));
+    clReleaseEvent(evt);
+}
 
-    cl_context cpu_context = clCreateContext(cpu_properties, 1, &cpu_dev_pair.second, nullptr, nullptr, &error);
-    CONTROL("clCreateContext CPU", error);
-    cl_context gpu_context = clCreateContext(gpu_properties, 1, &gpu_dev_pair.second, nullptr, nullptr, &error);
-    CONTROL("clCreateContext GPU", error);
+// One device of the pipelined GEMM: rows [begin, end) of C are streamed in panels of GEMM_PANEL rows.
+// Uploads, kernels and downloads go to three in-order queues, so the upload of the next panel and
+// the download of the previous one overlap with the kernel; A and C panels are double buffered
+struct GemmPipeline {
+    std::pair<cl_platform_id, cl_device_id>* dev_pair = nullptr;
+    size_t begin = 0, end = 0;
+    cl_context context = nullptr;
+    cl_command_queue upload = nullptr, compute = nullptr, download = nullptr;
+    cl_program program = nullptr;
+    cl_kernel kernel = nullptr;
+    cl_mem b_buffer = nullptr, a_panels[2] = { nullptr, nullptr }, c_panels[2] = { nullptr, nullptr };
+    cl_event b_evt = nullptr, kernel_evt[2] = { nullptr, nullptr }, read_evt[2] = { nullptr, nullptr };
+};
 
-    cl_command_queue cpu_queue = clCreateCommandQueue(cpu_context, cpu_dev_pair.second, 0, &error);
-    CONTROL("clCreateCommandQueue CPU", error);
-    cl_command_queue gpu_queue = clCreateCommandQueue(gpu_context, gpu_dev_pair.second, 0, &error);
-    CONTROL("clCreateCommandQueue GPU", error);
+static void createGemmPipeline(GemmPipeline& p, const size_t n, const size_t k, const float* b) {
+    cl_int error = CL_SUCCESS;
+    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)p.dev_pair->first, 0 };
+    p.context = clCreateContext(properties, 1, &p.dev_pair->second, nullptr, nullptr, &error);
+    CONTROL("clCreateContext", error);
+    p.upload = clCreateCommandQueue(p.context, p.dev_pair->second, 0, &error);
+    CONTROL("clCreateCommandQueue", error);
+    p.compute = clCreateCommandQueue(p.context, p.dev_pair->second, 0, &error);
+    CONTROL("clCreateCommandQueue", error);
+    p.download = clCreateCommandQueue(p.context, p.dev_pair->second, 0, &error);
+    CONTROL("clCreateCommandQueue", error);
 
-    cl_program cpu_program = createProgramFromSource(cpu_context, "kernels/gemm_kernel.cl");
-    cl_program gpu_program = createProgramFromSource(gpu_context, "kernels/gemm_kernel.cl");
+    p.program = createProgramFromSource(p.context, "kernels/gemm_kernel.cl");
     std::string build_options = "-DBLOCK=" + std::to_string(BLOCK);
-    CONTROL("clBuildProgram CPU", clBuildProgram(cpu_program, 1, &cpu_dev_pair.second, build_options.c_str(), nullptr, nullptr));
-    CONTROL("clBuildProgram GPU", clBuildProgram(gpu_program, 1, &gpu_dev_pair.second, build_options.c_str(), nullptr, nullptr));
-
-    cl_kernel cpu_kernel = clCreateKernel(cpu_program, "gemm", &error);
-    CONTROL("clCreateKernel CPU", error);
-    cl_kernel gpu_kernel = clCreateKernel(gpu_program, "gemm", &error);
-    CONTROL("clCreateKernel GPU", error);
-
-    size_t group = BLOCK;
-    const size_t cpu_m = m - gpu_m;
-    cl_mem gpu_a_buffer = nullptr, gpu_b_buffer = nullptr, gpu_c_buffer = nullptr, cpu_a_buffer = nullptr, cpu_b_buffer = nullptr, cpu_c_buffer = nullptr;
-    if (gpu_m > 0) {
-        gpu_a_buffer = clCreateBuffer(gpu_context, CL_MEM_READ_ONLY, sizeof(float) * gpu_m * n, nullptr, &error);
-        CONTROL("clCreateBuffer A", error);
-        gpu_b_buffer = clCreateBuffer(gpu_context, CL_MEM_READ_ONLY, sizeof(float) * n * k, nullptr, &error);
-        CONTROL("clCreateBuffer B", error);
-        gpu_c_buffer = clCreateBuffer(gpu_context, CL_MEM_WRITE_ONLY, sizeof(float) * gpu_m * k, nullptr, &error);
-        CONTROL("clCreateBuffer C", error);
-        CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(gpu_queue, gpu_a_buffer, CL_TRUE, 0, sizeof(float) * gpu_m * n, a, 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(gpu_queue, gpu_b_buffer, CL_TRUE, 0, sizeof(float) * n * k, b, 0, nullptr, nullptr));
-        CONTROL("clSetKernelArg M", clSetKernelArg(gpu_kernel, 0, sizeof(unsigned int), &gpu_m));
-        CONTROL("clSetKernelArg N", clSetKernelArg(gpu_kernel, 1, sizeof(unsigned int), &n));
-        CONTROL("clSetKernelArg K", clSetKernelArg(gpu_kernel, 2, sizeof(unsigned int), &k));
-        CONTROL("clSetKernelArg A", clSetKernelArg(gpu_kernel, 3, sizeof(cl_mem), &gpu_a_buffer));
-        CONTROL("clSetKernelArg B", clSetKernelArg(gpu_kernel, 4, sizeof(cl_mem), &gpu_b_buffer));
-        CONTROL("clSetKernelArg C", clSetKernelArg(gpu_kernel, 5, sizeof(cl_mem), &gpu_c_buffer));
-        CONTROL("clGetKernelWorkGroupInf", clGetKernelWorkGroupInfo(gpu_kernel, gpu_dev_pair.second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &group, nullptr));
-    }
-
-    if (cpu_m > 0) {
-        cpu_a_buffer = clCreateBuffer(cpu_context, CL_MEM_READ_ONLY, sizeof(float) * cpu_m * n, nullptr, &error);
+    CONTROL("clBuildProgram", clBuildProgram(p.program, 1, &p.dev_pair->second, build_options.c_str(), nullptr, nullptr));
+    p.kernel = clCreateKernel(p.program, "gemm", &error);
+    CONTROL("clCreateKernel", error);
+
+    p.b_buffer = clCreateBuffer(p.context, CL_MEM_READ_ONLY, sizeof(float) * n * k, nullptr, &error);
+    CONTROL("clCreateBuffer B", error);
+    for (int slot = 0; slot < 2; ++slot) {
+        p.a_panels[slot] = clCreateBuffer(p.context, CL_MEM_READ_ONLY, sizeof(float) * GEMM_PANEL * n, nullptr, &error);
         CONTROL("clCreateBuffer A", error);
-        cpu_b_buffer = clCreateBuffer(cpu_context, CL_MEM_READ_ONLY, sizeof(float) * n * k, nullptr, &error);
-        CONTROL("clCreateBuffer B", error);
-        cpu_c_buffer = clCreateBuffer(cpu_context, CL_MEM_WRITE_ONLY, sizeof(float) * cpu_m * k, nullptr, &error);
+        p.c_panels[slot] = clCreateBuffer(p.context, CL_MEM_WRITE_ONLY, sizeof(float) * GEMM_PANEL * k, nullptr, &error);
         CONTROL("clCreateBuffer C", error);
-        CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(cpu_queue, cpu_a_buffer, CL_TRUE, 0, sizeof(float) * cpu_m * n, &a[gpu_m * n], 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(cpu_queue, cpu_b_buffer, CL_TRUE, 0, sizeof(float) * n * k, b, 0, nullptr, nullptr));
-        CONTROL("clSetKernelArg M", clSetKernelArg(cpu_kernel, 0, sizeof(unsigned int), &cpu_m));
-        CONTROL("clSetKernelArg N", clSetKernelArg(cpu_kernel, 1, sizeof(unsigned int), &n));
-        CONTROL("clSetKernelArg K", clSetKernelArg(cpu_kernel, 2, sizeof(unsigned int), &k));
-        CONTROL("clSetKernelArg A", clSetKernelArg(cpu_kernel, 3, sizeof(cl_mem), &cpu_a_buffer));
-        CONTROL("clSetKernelArg B", clSetKernelArg(cpu_kernel, 4, sizeof(cl_mem), &cpu_b_buffer));
-        CONTROL("clSetKernelArg C", clSetKernelArg(cpu_kernel, 5, sizeof(cl_mem), &cpu_c_buffer));
-        CONTROL("clGetKernelWorkGroupInf", clGetKernelWorkGroupInfo(cpu_kernel, cpu_dev_pair.second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &group, nullptr));
     }
+    // B goes once and asynchronously, the first kernel waits for it
+    CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(p.upload, p.b_buffer, CL_FALSE, 0, sizeof(float) * n * k, b, 0, nullptr, &p.b_evt));
+
+    CONTROL("clSetKernelArg N", clSetKernelArg(p.kernel, 1, sizeof(unsigned int), &n));
+    CONTROL("clSetKernelArg K", clSetKernelArg(p.kernel, 2, sizeof(unsigned int), &k));
+    CONTROL("clSetKernelArg B", clSetKernelArg(p.kernel, 4, sizeof(cl_mem), &p.b_buffer));
+}
+
+// Enqueues the panel of rows [row, row + rows): upload of A, the kernel and download of C straight into c
+static void enqueueGemmPanel(GemmPipeline& p, const size_t row, const size_t rows, const size_t slot,
+    const size_t n, const size_t k, const float* a, float* c) {
+    // the slot is free once the kernel two panels ago read A and its C was downloaded
+    cl_event write_evt = nullptr;
+    const cl_uint slot_waits = p.kernel_evt[slot] != nullptr;
+    CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(p.upload, p.a_panels[slot], CL_FALSE, 0, sizeof(float) * rows * n, &a[row * n],
+        slot_waits, slot_waits ? &p.kernel_evt[slot] : nullptr, &write_evt));
 
+    cl_event kernel_waits[3] = { write_evt, p.b_evt, p.read_evt[slot] };
+    const cl_uint kernel_wait_count = p.read_evt[slot] != nullptr ? 3 : 2;
+    const unsigned int panel_rows = rows;
+    CONTROL("clSetKernelArg M", clSetKernelArg(p.kernel, 0, sizeof(unsigned int), &panel_rows));
+    CONTROL("clSetKernelArg A", clSetKernelArg(p.kernel, 3, sizeof(cl_mem), &p.a_panels[slot]));
+    CONTROL("clSetKernelArg C", clSetKernelArg(p.kernel, 5, sizeof(cl_mem), &p.c_panels[slot]));
     const size_t ndims = 2;
-    size_t global[ndims] = { k, gpu_m };
+    size_t global[ndims] = { k, rows };
     size_t local[ndims] = { BLOCK, BLOCK };
+    if (p.kernel_evt[slot] != nullptr)
+        clReleaseEvent(p.kernel_evt[slot]);
+    CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(p.compute, p.kernel, ndims, nullptr, global, local, kernel_wait_count, kernel_waits, &p.kernel_evt[slot]));
+    clReleaseEvent(write_evt);
+
+    if (p.read_evt[slot] != nullptr)
+        clReleaseEvent(p.read_evt[slot]);
+    CONTROL("clEnqueueReadBuffer C", clEnqueueReadBuffer(p.download, p.c_panels[slot], CL_FALSE, 0, sizeof(float) * rows * k, &c[row * k],
+        1, &p.kernel_evt[slot], &p.read_evt[slot]));
+
+    CONTROL("clFlush", clFlush(p.upload));
+    CONTROL("clFlush", clFlush(p.compute));
+    CONTROL("clFlush", clFlush(p.download));
+}
 
+static void releaseGemmPipeline(GemmPipeline& p) {
+    for (int slot = 0; slot < 2; ++slot) {
+        if (p.kernel_evt[slot] != nullptr)
+            clReleaseEvent(p.kernel_evt[slot]);
+        if (p.read_evt[slot] != nullptr)
+            clReleaseEvent(p.read_evt[slot]);
+        clReleaseMemObject(p.a_panels[slot]);
+        clReleaseMemObject(p.c_panels[slot]);
+    }
+    clReleaseEvent(p.b_evt);
+    clReleaseMemObject(p.b_buffer);
+    clReleaseKernel(p.kernel);
+    clReleaseProgram(p.program);
+    clReleaseCommandQueue(p.upload);
+    clReleaseCommandQueue(p.compute);
+    clReleaseCommandQueue(p.download);
+    clReleaseContext(p.context);
+}
+
+void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time, const size_t gpu_m) {
+    std::vector<GemmPipeline> all(2);
+    all[0].dev_pair = &gpu_dev_pair; all[0].begin = 0;     all[0].end = gpu_m;
+    all[1].dev_pair = &cpu_dev_pair; all[1].begin = gpu_m; all[1].end = m;
+    std::vector<GemmPipeline*> devices;
+    for (auto& p : all)
+        if (p.end > p.begin)
+            devices.push_back(&p);
+
+    for (auto p : devices)
+        createGemmPipeline(*p, n, k, b);
     time.first = std::chrono::high_resolution_clock::now();
-    if (gpu_m > 0) {
-        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(gpu_queue, gpu_kernel, ndims, nullptr, global, local, 0, nullptr, nullptr));
+
+    // the panels of both devices are enqueued in turn, so both start on their first panel
+    size_t slot = 0;
+    for (size_t offset = 0; ; offset += GEMM_PANEL, slot ^= 1) {
+        bool enqueued = false;
+        for (auto p : devices) {
+            const size_t row = p->begin + offset;
+            if (row >= p->end)
+                continue;
+            enqueueGemmPanel(*p, row, std::min<size_t>(GEMM_PANEL, p->end - row), slot, n, k, a, c);
+            enqueued = true;
+        }
+        if (!enqueued)
+            break;
     }
-    if (cpu_m > 0) {
-        global[1] = cpu_m;
-        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(cpu_queue, cpu_kernel, ndims, nullptr, global, local, 0, nullptr, nullptr));
+
+    // every device arrives once the download of its last panel is done
+    CompletionBarrier barrier;
+    barrier.reset(devices.size());
+    for (auto p : devices) {
+        cl_event last_evt = nullptr;
+        CONTROL("clEnqueueMarkerWithWaitList", clEnqueueMarkerWithWaitList(p->download, 0, nullptr, &last_evt));
+        arriveOnComplete(last_evt, barrier);
+        CONTROL("clFlush", clFlush(p->download));
     }
-    CONTROL("clFinish", clFinish(gpu_queue));
-    CONTROL("clFinish", clFinish(cpu_queue));
+    barrier.wait();
     time.second = std::chrono::high_resolution_clock::now();
 
-    if (gpu_m > 0) {
-        clEnqueueReadBuffer(gpu_queue, gpu_c_buffer, CL_TRUE, 0, sizeof(float) * gpu_m * k, c, 0, nullptr, nullptr);
-        clReleaseMemObject(gpu_a_buffer);
-        clReleaseMemObject(gpu_b_buffer);
-        clReleaseMemObject(gpu_c_buffer);
-    }
-    if (cpu_m > 0) {
-        clEnqueueReadBuffer(cpu_queue, cpu_c_buffer, CL_TRUE, 0, sizeof(float) * cpu_m * k, &c[gpu_m * k], 0, nullptr, nullptr);
-        clReleaseMemObject(cpu_a_buffer);
-        clReleaseMemObject(cpu_b_buffer);
-        clReleaseMemObject(cpu_c_buffer);
-    }
+    for (auto p : devices)
+        releaseGemmPipeline(*p);
+}
 
-    clReleaseProgram(cpu_program);    clReleaseProgram(gpu_program);
-    clReleaseKernel(cpu_kernel);      clReleaseKernel(gpu_kernel);
-    clReleaseCommandQueue(cpu_queue); clReleaseCommandQueue(gpu_queue);
-    clReleaseContext(cpu_context);    clReleaseContext(gpu_context);
+// One device of the partitioned Jacobi: it holds only the rows [begin, end) of A and b,
+// x0 and x1 are full vectors where only the own slice is computed and the rest is received
+struct JacobiPart {
+    std::pair<cl_platform_id, cl_device_id>* dev_pair = nullptr;
+    size_t begin = 0, end = 0;
+    cl_context context = nullptr;
+    cl_command_queue queue = nullptr;
+    cl_program program = nullptr;
+    cl_kernel kernel = nullptr;
+    cl_mem a_buffer = nullptr, b_buffer = nullptr, x0_buffer = nullptr, x1_buffer = nullptr, norm_buffer = nullptr;
+    size_t global_size = 0, group_size = 0;
+    cl_event kernel_evt = nullptr, read_evt = nullptr, halo_evt[2] = { nullptr, nullptr };
+    cl_int norm = 0;
+    float accuracy = 0.0f;          // norm of the last sweep
+    cl_ulong kernel_time = 0;       // kernel time of the last sweep
+    double busy = 0.0;
+    CompletionBarrier* barrier = nullptr;
+};
+
+static cl_ulong eventTime(cl_event& evt) {
+    if (evt == nullptr)
+        return 0;
+    cl_ulong evt_start_time = 0, evt_end_time = 0;
+    CONTROL("clGetEventProfilingInfo Start", clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &evt_start_time, nullptr));
+    CONTROL("clGetEventProfilingInfo End", clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &evt_end_time, nullptr));
+    clReleaseEvent(evt);
+    evt = nullptr;
+    return evt_end_time - evt_start_time;
 }
 
-void jacobi_cl(float* a, float* b, float* x0, float* x1, float* norm, int size,
-    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time,
-    cl_ulong& kernel_time, const int gpu_m) {
+// Kernel, rows of A and b and the norm of a part whose context, queue and program already exist
+static void createJacobiKernel(JacobiPart& p, const float* a, const float* b, int size, const unsigned int x1_offset) {
     cl_int error = CL_SUCCESS;
-    cl_context_properties cpu_properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)cpu_dev_pair.first, 0 };
-    cl_context_properties gpu_properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)gpu_dev_pair.first, 0 };
+    const size_t rows = p.end - p.begin;
+    p.kernel = clCreateKernel(p.program, "jacobi", &error);
+    CONTROL("clCreateKernel", error);
+
+    p.a_buffer = clCreateBuffer(p.context, CL_MEM_READ_ONLY, sizeof(float) * rows * size, nullptr, &error);
+    CONTROL("clCreateBuffer A", error);
+    p.b_buffer = clCreateBuffer(p.context, CL_MEM_READ_ONLY, sizeof(float) * rows, nullptr, &error);
+    CONTROL("clCreateBuffer B", error);
+    p.norm_buffer = clCreateBuffer(p.context, CL_MEM_READ_WRITE, sizeof(cl_int), nullptr, &error);
+    CONTROL("clCreateBuffer NORM", error);
+
+    // element (i, j) is a[j * size + i]: the own rows are a rectangle of `rows` floats in each of `size` columns
+    const size_t origin[3] = { 0, 0, 0 };
+    const size_t host_origin[3] = { sizeof(float) * p.begin, 0, 0 };
+    const size_t region[3] = { sizeof(float) * rows, static_cast<size_t>(size), 1 };
+    CONTROL("clEnqueueWriteBufferRect A", clEnqueueWriteBufferRect(p.queue, p.a_buffer, CL_TRUE, origin, host_origin, region,
+        sizeof(float) * rows, 0, sizeof(float) * size, 0, a, 0, nullptr, nullptr));
+    CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(p.queue, p.b_buffer, CL_TRUE, 0, sizeof(float) * rows, &b[p.begin], 0, nullptr, nullptr));
+
+    const unsigned int own_rows = rows, first_row = p.begin;
+    CONTROL("clSetKernelArg A", clSetKernelArg(p.kernel, 0, sizeof(cl_mem), &p.a_buffer));
+    CONTROL("clSetKernelArg B", clSetKernelArg(p.kernel, 1, sizeof(cl_mem), &p.b_buffer));
+    CONTROL("clSetKernelArg NORM", clSetKernelArg(p.kernel, 4, sizeof(cl_mem), &p.norm_buffer));
+    CONTROL("clSetKernelArg size", clSetKernelArg(p.kernel, 5, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg rows", clSetKernelArg(p.kernel, 6, sizeof(unsigned int), &own_rows));
+    CONTROL("clSetKernelArg first_row", clSetKernelArg(p.kernel, 7, sizeof(unsigned int), &first_row));
+    CONTROL("clSetKernelArg x1_offset", clSetKernelArg(p.kernel, 9, sizeof(unsigned int), &x1_offset));
 
-    cl_context cpu_context = clCreateContext(cpu_properties, 1, &cpu_dev_pair.second, nullptr, nullptr, &error);
-    CONTROL("clCreateContext CPU", error);
-    cl_context gpu_context = clCreateContext(gpu_properties, 1, &gpu_dev_pair.second, nullptr, nullptr, &error);
-    CONTROL("clCreateContext GPU", error);
+    // the norm reduction needs a power of two
+    size_t max_group_size = 0;
+    CONTROL("clGetKernelWorkGroupInfo", clGetKernelWorkGroupInfo(p.kernel, p.dev_pair->second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_group_size, nullptr));
+    p.group_size = 1;
+    while (p.group_size * 2 <= max_group_size)
+        p.group_size *= 2;
+    p.global_size = (rows + p.group_size - 1) / p.group_size * p.group_size;
+    CONTROL("clSetKernelArg scratch", clSetKernelArg(p.kernel, 8, sizeof(float) * p.group_size, nullptr));
+}
 
+static void createJacobiPart(JacobiPart& p, const float* a, const float* b, const float* x0, int size) {
+    cl_int error = CL_SUCCESS;
+    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)p.dev_pair->first, 0 };
+    p.context = clCreateContext(properties, 1, &p.dev_pair->second, nullptr, nullptr, &error);
+    CONTROL("clCreateContext", error);
     cl_queue_properties props[3] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
-    cl_command_queue cpu_queue = clCreateCommandQueueWithProperties(cpu_context, cpu_dev_pair.second, props, &error);
-    CONTROL("clCreateCommandQueue CPU", error);
-    cl_command_queue gpu_queue = clCreateCommandQueueWithProperties(gpu_context, gpu_dev_pair.second, props, &error);
-    CONTROL("clCreateCommandQueue GPU", error);
+    p.queue = clCreateCommandQueueWithProperties(p.context, p.dev_pair->second, props, &error);
+    CONTROL("clCreateCommandQueue", error);
 
-    cl_program gpu_program = createProgramFromSource(gpu_context, "kernels/jacobi_kernel.cl");
-    cl_program cpu_program = createProgramFromSource(cpu_context, "kernels/jacobi_kernel.cl");
-    CONTROL("clBuildProgram GPU", clBuildProgram(gpu_program, 1, &gpu_dev_pair.second, nullptr, nullptr, nullptr));
-    CONTROL("clBuildProgram CPU", clBuildProgram(cpu_program, 1, &cpu_dev_pair.second, nullptr, nullptr, nullptr));
+    p.program = createProgramFromSource(p.context, "kernels/jacobi_kernel.cl");
+    CONTROL("clBuildProgram", clBuildProgram(p.program, 1, &p.dev_pair->second, nullptr, nullptr, nullptr));
+    createJacobiKernel(p, a, b, size, 0);
 
-    cl_kernel gpu_kernel = clCreateKernel(gpu_program, "jacobi", &error);
-    CONTROL("clCreateKernel", error);
-    cl_kernel cpu_kernel = clCreateKernel(cpu_program, "jacobi", &error);
-    CONTROL("clCreateKernel", error);
+    p.x0_buffer = clCreateBuffer(p.context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
+    CONTROL("clCreateBuffer X0", error);
+    p.x1_buffer = clCreateBuffer(p.context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
+    CONTROL("clCreateBuffer X1", error);
+    CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(p.queue, p.x0_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, nullptr, nullptr));
+}
 
-    const size_t cpu_m = size - gpu_m;
-    size_t cpu_global_size = 0, gpu_global_size = 0;
-    size_t cpu_group_size = 0, gpu_group_size = 0;
-    cl_mem gpu_a_buffer = nullptr, gpu_b_buffer = nullptr, gpu_x0_buffer = nullptr, gpu_x1_buffer = nullptr, gpu_norm_buffer = nullptr;
-    cl_mem cpu_a_buffer = nullptr, cpu_b_buffer = nullptr, cpu_x0_buffer = nullptr, cpu_x1_buffer = nullptr, cpu_norm_buffer = nullptr;
-    if (gpu_m > 0) {
-        const size_t stride = 0;
-        gpu_a_buffer = clCreateBuffer(gpu_context, CL_MEM_READ_ONLY, sizeof(float) * size * size, nullptr, &error);
-        CONTROL("clCreateBuffer A", error);
-        gpu_b_buffer = clCreateBuffer(gpu_context, CL_MEM_READ_ONLY, sizeof(float) * gpu_m, nullptr, &error);
-        CONTROL("clCreateBuffer B", error);
-        gpu_x0_buffer = clCreateBuffer(gpu_context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
-        CONTROL("clCreateBuffer X0", error);
-        gpu_x1_buffer = clCreateBuffer(gpu_context, CL_MEM_READ_WRITE, sizeof(float) * gpu_m, nullptr, &error);
-        CONTROL("clCreateBuffer X1", error);
-        gpu_norm_buffer = clCreateBuffer(gpu_context, CL_MEM_WRITE_ONLY, sizeof(float) * gpu_m, nullptr, &error);
-        CONTROL("clCreateBuffer NORM", error);
-
-        CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(gpu_queue, gpu_a_buffer, CL_TRUE, 0, sizeof(float) * size * size, a, 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(gpu_queue, gpu_b_buffer, CL_TRUE, 0, sizeof(float) * gpu_m, b, 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(gpu_queue, gpu_x0_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer X1", clEnqueueWriteBuffer(gpu_queue, gpu_x1_buffer, CL_TRUE, 0, sizeof(float) * gpu_m, x1, 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer NORM", clEnqueueWriteBuffer(gpu_queue, gpu_norm_buffer, CL_TRUE, 0, sizeof(float) * gpu_m, norm, 0, nullptr, nullptr));
-
-        CONTROL("clSetKernelArg A", clSetKernelArg(gpu_kernel, 0, sizeof(cl_mem), &gpu_a_buffer));
-        CONTROL("clSetKernelArg B", clSetKernelArg(gpu_kernel, 1, sizeof(cl_mem), &gpu_b_buffer));
-        CONTROL("clSetKernelArg X0", clSetKernelArg(gpu_kernel, 2, sizeof(cl_mem), &gpu_x0_buffer));
-        CONTROL("clSetKernelArg X1", clSetKernelArg(gpu_kernel, 3, sizeof(cl_mem), &gpu_x1_buffer));
-        CONTROL("clSetKernelArg NORM", clSetKernelArg(gpu_kernel, 4, sizeof(cl_mem), &gpu_norm_buffer));
-        CONTROL("clSetKernelArg size", clSetKernelArg(gpu_kernel, 5, sizeof(unsigned int), &size));
-        CONTROL("clSetKernelArg size", clSetKernelArg(gpu_kernel, 6, sizeof(unsigned int), &stride));
-        CONTROL("clGetKernelWorkGroupInf", clGetKernelWorkGroupInfo(gpu_kernel, gpu_dev_pair.second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &gpu_group_size, nullptr));
-        gpu_global_size = (gpu_m % gpu_group_size == 0) ? gpu_m : gpu_m + gpu_group_size - gpu_m % gpu_group_size;
-    }
-
-    if (cpu_m > 0) {
-        const size_t stride = gpu_m;
-        cpu_a_buffer = clCreateBuffer(cpu_context, CL_MEM_READ_ONLY, sizeof(float) * size * size, nullptr, &error);
-        CONTROL("clCreateBuffer A", error);
-        cpu_b_buffer = clCreateBuffer(cpu_context, CL_MEM_READ_ONLY, sizeof(float) * cpu_m, nullptr, &error);
-        CONTROL("clCreateBuffer B", error);
-        cpu_x0_buffer = clCreateBuffer(cpu_context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
-        CONTROL("clCreateBuffer X0", error);
-        cpu_x1_buffer = clCreateBuffer(cpu_context, CL_MEM_READ_WRITE, sizeof(float) * cpu_m, nullptr, &error);
-        CONTROL("clCreateBuffer X1", error);
-        cpu_norm_buffer = clCreateBuffer(cpu_context, CL_MEM_WRITE_ONLY, sizeof(float) * cpu_m, nullptr, &error);
-        CONTROL("clCreateBuffer NORM", error);
-
-        CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(cpu_queue, cpu_a_buffer, CL_TRUE, 0, sizeof(float) * size * size, a, 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(cpu_queue, cpu_b_buffer, CL_TRUE, 0, sizeof(float) * cpu_m, &b[gpu_m], 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(cpu_queue, cpu_x0_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer X1", clEnqueueWriteBuffer(cpu_queue, cpu_x1_buffer, CL_TRUE, 0, sizeof(float) * cpu_m, &x1[gpu_m], 0, nullptr, nullptr));
-        CONTROL("clEnqueueWriteBuffer NORM", clEnqueueWriteBuffer(cpu_queue, cpu_norm_buffer, CL_TRUE, 0, sizeof(float) * cpu_m, &norm[gpu_m], 0, nullptr, nullptr));
-
-        CONTROL("clSetKernelArg A", clSetKernelArg(cpu_kernel, 0, sizeof(cl_mem), &cpu_a_buffer));
-        CONTROL("clSetKernelArg B", clSetKernelArg(cpu_kernel, 1, sizeof(cl_mem), &cpu_b_buffer));
-        CONTROL("clSetKernelArg X0", clSetKernelArg(cpu_kernel, 2, sizeof(cl_mem), &cpu_x0_buffer));
-        CONTROL("clSetKernelArg X1", clSetKernelArg(cpu_kernel, 3, sizeof(cl_mem), &cpu_x1_buffer));
-        CONTROL("clSetKernelArg NORM", clSetKernelArg(cpu_kernel, 4, sizeof(cl_mem), &cpu_norm_buffer));
-        CONTROL("clSetKernelArg size", clSetKernelArg(cpu_kernel, 5, sizeof(unsigned int), &size));
-        CONTROL("clSetKernelArg stride", clSetKernelArg(cpu_kernel, 6, sizeof(unsigned int), &stride));
-        CONTROL("clGetKernelWorkGroupInf", clGetKernelWorkGroupInfo(cpu_kernel, cpu_dev_pair.second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &cpu_group_size, nullptr));
-        cpu_global_size = (cpu_m % cpu_group_size == 0) ? cpu_m : cpu_m + cpu_group_size - cpu_m % cpu_group_size;
+// Post-processing of a sweep on one device, runs from the event callback as soon as the device is done
+static void CL_CALLBACK jacobiPartDone(cl_event evt, cl_int event_status, void* user_data) {
+    JacobiPart& p = *static_cast<JacobiPart*>(user_data);
+    if (event_status == CL_COMPLETE) {
+        try {
+            p.kernel_time = eventTime(p.kernel_evt);
+            p.busy += (p.kernel_time + eventTime(p.read_evt) + eventTime(p.halo_evt[0]) + eventTime(p.halo_evt[1])) * 1e-9;
+            std::memcpy(&p.accuracy, &p.norm, sizeof(float));
+        }
+        catch (...) {
+            event_status = CL_INVALID_EVENT;
+        }
+    }
+    clReleaseEvent(evt);
+    p.barrier->arrive(event_status);
+}
+
+static void releaseJacobiPart(JacobiPart& p) {
+    clReleaseMemObject(p.a_buffer);
+    clReleaseMemObject(p.b_buffer);
+    clReleaseMemObject(p.x0_buffer);
+    clReleaseMemObject(p.x1_buffer);
+    clReleaseMemObject(p.norm_buffer);
+    clReleaseKernel(p.kernel);
+    clReleaseProgram(p.program);
+    clReleaseCommandQueue(p.queue);
+    clReleaseContext(p.context);
+}
+
+// Rows of x a sub-buffer may start at on every device of the parts, 0 if they aren't on one platform
+static size_t sharedRowAlignment(const std::vector<std::pair<cl_platform_id, cl_device_id>*>& dev_pairs) {
+    size_t alignment = 1;
+    for (auto dev_pair : dev_pairs) {
+        if (dev_pair->first != dev_pairs.front()->first)
+            return 0;
+        cl_uint align_bits = 0;
+        CONTROL("clGetDeviceInfo", clGetDeviceInfo(dev_pair->second, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &align_bits, nullptr));
+        alignment = std::max<size_t>(alignment, align_bits / (8 * sizeof(float)));
+    }
+    return alignment;
+}
+
+// Shared-context mode: one context for the devices of one platform, x0 and x1 are allocated once and
+// every device writes its rows through a sub-buffer, so the slices never go through the host. Every device
+// reads the whole x0, so the runtime moves it implicitly: a sweep is enqueued only after the barrier saw
+// all commands of the previous one complete
+static int jacobiShared(const float* a, const float* b, const float* x0, float* x1, int size, std::vector<JacobiPart*>& parts,
+    timer& time, cl_ulong& kernel_time, const int max_iters, float& accuracy) {
+    cl_int error = CL_SUCCESS;
+    std::vector<cl_device_id> devices;
+    for (auto p : parts)
+        devices.push_back(p->dev_pair->second);
+    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)parts.front()->dev_pair->first, 0 };
+    cl_context context = clCreateContext(properties, devices.size(), devices.data(), nullptr, nullptr, &error);
+    CONTROL("clCreateContext", error);
+    cl_program program = createProgramFromSource(context, "kernels/jacobi_kernel.cl");
+    CONTROL("clBuildProgram", clBuildProgram(program, devices.size(), devices.data(), nullptr, nullptr, nullptr));
+
+    cl_mem x_buffers[2];
+    x_buffers[0] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(float) * size, const_cast<float*>(x0), &error);
+    CONTROL("clCreateBuffer X0", error);
+    x_buffers[1] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
+    CONTROL("clCreateBuffer X1", error);
+
+    cl_queue_properties props[3] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+    for (auto p : parts) {
+        p->context = context;
+        p->program = program;
+        p->queue = clCreateCommandQueueWithProperties(context, p->dev_pair->second, props, &error);
+        CONTROL("clCreateCommandQueue", error);
+        createJacobiKernel(*p, a, b, size, p->begin);
+        // x0_buffer and x1_buffer of a part are its slices of the shared vectors
+        cl_buffer_region region = { sizeof(float) * p->begin, sizeof(float) * (p->end - p->begin) };
+        p->x0_buffer = clCreateSubBuffer(x_buffers[0], CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &error);
+        CONTROL("clCreateSubBuffer X0", error);
+        p->x1_buffer = clCreateSubBuffer(x_buffers[1], CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &error);
+        CONTROL("clCreateSubBuffer X1", error);
     }
 
     kernel_time = 0;
-    cl_event cpu_evt = nullptr, gpu_evt = nullptr;
-    float accuracy = 0.0;
+    accuracy = 0.0;
     int iters = 0;
+    const cl_int zero = 0;
+    CompletionBarrier barrier;
+    for (auto p : parts)
+        p->barrier = &barrier;
 
     time.first = std::chrono::high_resolution_clock::now();
     while (true) {
-        if (gpu_m > 0) {
-            CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(gpu_queue, gpu_kernel, 1, nullptr, &gpu_global_size, &gpu_group_size, 0, nullptr, &gpu_evt));
-        }
-        if (cpu_m > 0) {
-            CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(cpu_queue, cpu_kernel, 1, nullptr, &cpu_global_size, &cpu_group_size, 0, nullptr, &cpu_evt));
+        barrier.reset(parts.size());
+        for (auto p : parts) {
+            CONTROL("clSetKernelArg X0", clSetKernelArg(p->kernel, 2, sizeof(cl_mem), &x_buffers[0]));
+            CONTROL("clSetKernelArg X1", clSetKernelArg(p->kernel, 3, sizeof(cl_mem), &p->x1_buffer));
+            CONTROL("clEnqueueFillBuffer NORM", clEnqueueFillBuffer(p->queue, p->norm_buffer, &zero, sizeof(cl_int), 0, sizeof(cl_int), 0, nullptr, nullptr));
+            CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(p->queue, p->kernel, 1, nullptr, &p->global_size, &p->group_size, 0, nullptr, &p->kernel_evt));
+            cl_event norm_evt = nullptr;
+            CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(p->queue, p->norm_buffer, CL_FALSE, 0, sizeof(cl_int), &p->norm, 0, nullptr, &norm_evt));
+            CONTROL("clSetEventCallback", clSetEventCallback(norm_evt, CL_COMPLETE, jacobiPartDone, p));
+            CONTROL("clFlush", clFlush(p->queue));
         }
-        if (gpu_m > 0) {
-            CONTROL("clWaitForEvents", clWaitForEvents(1, &gpu_evt));
+        barrier.wait();
+
+        cl_ulong max_kernel_time = 0;
+        accuracy = 0.0f;
+        for (auto p : parts) {
+            max_kernel_time = std::max(max_kernel_time, p->kernel_time);
+            accuracy = std::max(accuracy, p->accuracy);
         }
-        if (cpu_m > 0) {
-            CONTROL("clWaitForEvents", clWaitForEvents(1, &cpu_evt));
+        kernel_time += max_kernel_time;
+        iters++;
+
+        // x1 becomes x0 of the next sweep, the slices of all devices are already in it
+        std::swap(x_buffers[0], x_buffers[1]);
+        for (auto p : parts)
+            std::swap(p->x0_buffer, p->x1_buffer);
+        if (accuracy < EPS || iters >= max_iters)
+            break;
+    }
+    time.second = std::chrono::high_resolution_clock::now();
+
+    CONTROL("clEnqueueReadBuffer X", clEnqueueReadBuffer(parts.front()->queue, x_buffers[0], CL_TRUE, 0, sizeof(float) * size, x1, 0, nullptr, nullptr));
+    for (auto p : parts) {
+        clReleaseMemObject(p->a_buffer);
+        clReleaseMemObject(p->b_buffer);
+        clReleaseMemObject(p->x0_buffer);
+        clReleaseMemObject(p->x1_buffer);
+        clReleaseMemObject(p->norm_buffer);
+        clReleaseKernel(p->kernel);
+        clReleaseCommandQueue(p->queue);
+    }
+    clReleaseMemObject(x_buffers[0]);
+    clReleaseMemObject(x_buffers[1]);
+    clReleaseProgram(program);
+    clReleaseContext(context);
+    return iters;
+}
+
+// Static split of the rows given by the bounds of `all`, returns the count of iterations and writes the solution
+// to x1. Every device holds only its rows of A, reduces its norm itself and per sweep sends its slice of x
+// and receives the others. `busy` of a part is the seconds its device spent in kernels and transfers
+static int jacobiParts(const float* a, const float* b, const float* x0, float* x1, int size, std::vector<JacobiPart>& all,
+    timer& time, cl_ulong& kernel_time, const int max_iters, float& accuracy) {
+    std::vector<JacobiPart*> parts;
+    std::vector<std::pair<cl_platform_id, cl_device_id>*> dev_pairs;
+    for (auto& p : all) {
+        if (p.end > p.begin) {
+            parts.push_back(&p);
+            dev_pairs.push_back(p.dev_pair);
         }
+    }
+    if (HETERO_SHARED_CONTEXT && parts.size() > 1) {
+        const size_t alignment = sharedRowAlignment(dev_pairs);
+        bool aligned = alignment > 0;
+        for (auto p : parts)
+            aligned = aligned && p->begin % alignment == 0;
+        if (aligned)
+            return jacobiShared(a, b, x0, x1, size, parts, time, kernel_time, max_iters, accuracy);
+    }
+    for (auto p : parts)
+        createJacobiPart(*p, a, b, x0, size);
 
-        cl_ulong gpu_kernel_time = 0, cpu_kernel_time = 0;
-        cl_ulong evt_start_time = 0, evt_end_time = 0;
-        if (gpu_m > 0) {
-            CONTROL("clGetEventProfilingInfo Start", clGetEventProfilingInfo(gpu_evt, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &evt_start_time, nullptr));
-            CONTROL("clGetEventProfilingInfo End", clGetEventProfilingInfo(gpu_evt, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &evt_end_time, nullptr));
-            gpu_kernel_time = evt_end_time - evt_start_time;
+    // latest x: every device reads its slice into it and writes the slices of the others from it. The halo
+    // writes are non-blocking, so the next sweep reads into the other copy while they may still source this one
+    std::vector<float> x[2] = { std::vector<float>(x0, x0 + size), std::vector<float>(x0, x0 + size) };
+    int current = 0;
+    kernel_time = 0;
+    accuracy = 0.0;
+    int iters = 0;
+    const cl_int zero = 0;
+    CompletionBarrier barrier;
+    for (auto p : parts)
+        p->barrier = &barrier;
+
+    time.first = std::chrono::high_resolution_clock::now();
+    while (true) {
+        barrier.reset(parts.size());
+        for (auto p : parts) {
+            CONTROL("clSetKernelArg X0", clSetKernelArg(p->kernel, 2, sizeof(cl_mem), &p->x0_buffer));
+            CONTROL("clSetKernelArg X1", clSetKernelArg(p->kernel, 3, sizeof(cl_mem), &p->x1_buffer));
+            CONTROL("clEnqueueFillBuffer NORM", clEnqueueFillBuffer(p->queue, p->norm_buffer, &zero, sizeof(cl_int), 0, sizeof(cl_int), 0, nullptr, nullptr));
+            CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(p->queue, p->kernel, 1, nullptr, &p->global_size, &p->group_size, 0, nullptr, &p->kernel_evt));
+            CONTROL("clEnqueueReadBuffer X1", clEnqueueReadBuffer(p->queue, p->x1_buffer, CL_FALSE, sizeof(float) * p->begin, sizeof(float) * (p->end - p->begin),
+                &x[current][p->begin], 0, nullptr, &p->read_evt));
+            cl_event norm_evt = nullptr;
+            CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(p->queue, p->norm_buffer, CL_FALSE, 0, sizeof(cl_int), &p->norm, 0, nullptr, &norm_evt));
+            CONTROL("clSetEventCallback", clSetEventCallback(norm_evt, CL_COMPLETE, jacobiPartDone, p));
+            CONTROL("clFlush", clFlush(p->queue));
         }
-        if (cpu_m > 0) {
-            CONTROL("clGetEventProfilingInfo Start", clGetEventProfilingInfo(cpu_evt, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &evt_start_time, nullptr));
-            CONTROL("clGetEventProfilingInfo End", clGetEventProfilingInfo(cpu_evt, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &evt_end_time, nullptr));
-            cpu_kernel_time = evt_end_time - evt_start_time;
+        barrier.wait();
+
+        cl_ulong max_kernel_time = 0;
+        accuracy = 0.0f;
+        for (auto p : parts) {
+            max_kernel_time = std::max(max_kernel_time, p->kernel_time);
+            accuracy = std::max(accuracy, p->accuracy);
         }
+        kernel_time += max_kernel_time;
+        iters++;
 
-        kernel_time += std::max(gpu_kernel_time, cpu_kernel_time);
+        if (accuracy < EPS || iters >= max_iters)
+            break;
 
-        if (gpu_m > 0) {
-            CONTROL("clEnqueueReadBuffer X1", clEnqueueReadBuffer(gpu_queue, gpu_x1_buffer, CL_TRUE, 0, sizeof(float) * gpu_m, x1, 0, NULL, NULL));
-            CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(gpu_queue, gpu_norm_buffer, CL_TRUE, 0, sizeof(float) * gpu_m, norm, 0, NULL, NULL));
+        // x1 becomes x0 of the next sweep: it already has the own slice, the slices of the others arrive
+        for (auto p : parts) {
+            if (p->begin > 0) {
+                CONTROL("clEnqueueWriteBuffer X1", clEnqueueWriteBuffer(p->queue, p->x1_buffer, CL_FALSE, 0, sizeof(float) * p->begin, x[current].data(), 0, nullptr, &p->halo_evt[0]));
+            }
+            if (p->end < size) {
+                CONTROL("clEnqueueWriteBuffer X1", clEnqueueWriteBuffer(p->queue, p->x1_buffer, CL_FALSE, sizeof(float) * p->end, sizeof(float) * (size - p->end),
+                    &x[current][p->end], 0, nullptr, &p->halo_evt[1]));
+            }
+            std::swap(p->x0_buffer, p->x1_buffer);
         }
-        if (cpu_m > 0) {
-            CONTROL("clEnqueueReadBuffer X1", clEnqueueReadBuffer(cpu_queue, cpu_x1_buffer, CL_TRUE, 0, sizeof(float) * cpu_m, &x1[gpu_m], 0, NULL, NULL));
-            CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(cpu_queue, cpu_norm_buffer, CL_TRUE, 0, sizeof(float) * cpu_m, &norm[gpu_m], 0, NULL, NULL));
+        // In-order queues: the next barrier also completes these writes, before the copy is read into again
+        current ^= 1;
+    }
+    time.second = std::chrono::high_resolution_clock::now();
+
+    std::memcpy(x1, x[current].data(), sizeof(float) * size);
+    for (auto p : parts)
+        releaseJacobiPart(*p);
+    return iters;
+}
+
+// The GPU solves the first gpu_m rows, the CPU the rest
+static int jacobiSplit(const float* a, const float* b, const float* x0, float* x1, int size,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time,
+    cl_ulong& kernel_time, const int gpu_m, const int max_iters, float& accuracy, double& gpu_busy, double& cpu_busy) {
+    std::vector<JacobiPart> parts(2);
+    parts[0].dev_pair = &gpu_dev_pair; parts[0].begin = 0;     parts[0].end = gpu_m;
+    parts[1].dev_pair = &cpu_dev_pair; parts[1].begin = gpu_m; parts[1].end = size;
+    const int iters = jacobiParts(a, b, x0, x1, size, parts, time, kernel_time, max_iters, accuracy);
+    gpu_busy = parts[0].busy;
+    cpu_busy = parts[1].busy;
+    return iters;
+}
+
+static void printJacobiResult(const float accuracy, const int iters) {
+    if (accuracy < EPS)
+        std::cout << "[ INFO ] Accuracy (" << accuracy << ") is achieved (iters: " << iters << ")" << std::endl;
+    else if (iters >= MAX_ITERS)
+        std::cout << "[ INFO ] Accuracy isn't achieved (" << accuracy << "), count of iterations is exceeded" << std::endl;
+}
+
+void jacobi_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time,
+    cl_ulong& kernel_time, const int gpu_m) {
+    float accuracy = 0.0f;
+    double gpu_busy = 0.0, cpu_busy = 0.0;
+    const int iters = jacobiSplit(a, b, x0, x1, size, cpu_dev_pair, gpu_dev_pair, time, kernel_time, gpu_m, MAX_ITERS, accuracy, gpu_busy, cpu_busy);
+    printJacobiResult(accuracy, iters);
+}
+
+void jacobi_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time,
+    cl_ulong& kernel_time) {
+    float accuracy = 0.0f;
+    double gpu_busy = 0.0, cpu_busy = 0.0;
+    double gpu_share = 0.5;
+    if (!lookupSplit(cpu_dev_pair, gpu_dev_pair, HETERO_JACOBI, double(size) * size, gpu_share)) {
+        // probe: a few iterations on an even split
+        std::vector<float> x1_probe(size);
+        timer probe_time;
+        cl_ulong probe_kernel_time = 0;
+        const int probe_m = size / 2;
+        jacobiSplit(a, b, x0, x1_probe.data(), size, cpu_dev_pair, gpu_dev_pair, probe_time, probe_kernel_time,
+            probe_m, CALIBRATION_ITERS, accuracy, gpu_busy, cpu_busy);
+        updateSplit(cpu_dev_pair, gpu_dev_pair, HETERO_JACOBI, double(size) * size, probe_m, gpu_busy, size - probe_m, cpu_busy);
+        lookupSplit(cpu_dev_pair, gpu_dev_pair, HETERO_JACOBI, double(size) * size, gpu_share);
+    }
+
+    const int gpu_m = static_cast<int>(size * gpu_share);
+    std::cout << "[ INFO ] GPU share: " << gpu_share << std::endl;
+    const int iters = jacobiSplit(a, b, x0, x1, size, cpu_dev_pair, gpu_dev_pair, time, kernel_time, gpu_m, MAX_ITERS, accuracy, gpu_busy, cpu_busy);
+    if (gpu_m > 0 && gpu_m < size)
+        updateSplit(cpu_dev_pair, gpu_dev_pair, HETERO_JACOBI, double(size) * size, gpu_m, gpu_busy, size - gpu_m, cpu_busy);
+    printJacobiResult(accuracy, iters);
+}
+
+void jacobi_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+    std::vector<HeteroDevice>& devices, timer& time, cl_ulong& kernel_time) {
+    // devices of one platform share a context when their slices start at aligned rows
+    std::vector<std::pair<cl_platform_id, cl_device_id>*> dev_pairs;
+    for (auto& d : devices)
+        dev_pairs.push_back(&d.dev_pair);
+    const size_t alignment = HETERO_SHARED_CONTEXT ? sharedRowAlignment(dev_pairs) : 0;
+    const std::vector<size_t> bounds = splitRows(devices, size, std::max<size_t>(alignment, 1));
+    std::vector<JacobiPart> parts(devices.size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        parts[i].dev_pair = &devices[i].dev_pair;
+        parts[i].begin = bounds[i];
+        parts[i].end = bounds[i + 1];
+        std::cout << "[ INFO ] " << deviceName(devices[i].dev_pair) << ": rows " << bounds[i] << " - " << bounds[i + 1] << std::endl;
+    }
+    float accuracy = 0.0f;
+    const int iters = jacobiParts(a, b, x0, x1, size, parts, time, kernel_time, MAX_ITERS, accuracy);
+    printJacobiResult(accuracy, iters);
+}
+
+// One device of the dynamic GEMM: A, B and C are allocated in full, a tile of rows
+// [row, row + rows) is uploaded, computed with the global offset and read straight into c
+struct GemmDevice {
+    std::pair<cl_platform_id, cl_device_id>* dev_pair = nullptr;
+    cl_context context = nullptr;
+    cl_command_queue queue = nullptr;
+    cl_program program = nullptr;
+    cl_kernel kernel = nullptr;
+    cl_mem a_buffer = nullptr, b_buffer = nullptr, c_buffer = nullptr;
+    size_t rows = 0;        // rows computed by the device
+    double rate = 0.0;      // rows per second of the last tile
+    double share = 0.0;     // calibrated share of the rows, used until both rates are measured
+    double busy = 0.0;      // seconds spent in transfers and kernels
+    std::exception_ptr failure;
+};
+
+static void createGemmDevice(GemmDevice& d, const size_t m, const size_t n, const size_t k, const float* b) {
+    cl_int error = CL_SUCCESS;
+    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)d.dev_pair->first, 0 };
+    d.context = clCreateContext(properties, 1, &d.dev_pair->second, nullptr, nullptr, &error);
+    CONTROL("clCreateContext", error);
+    d.queue = clCreateCommandQueue(d.context, d.dev_pair->second, 0, &error);
+    CONTROL("clCreateCommandQueue", error);
+
+    d.program = createProgramFromSource(d.context, "kernels/gemm_kernel.cl");
+    std::string build_options = "-DBLOCK=" + std::to_string(BLOCK);
+    CONTROL("clBuildProgram", clBuildProgram(d.program, 1, &d.dev_pair->second, build_options.c_str(), nullptr, nullptr));
+    d.kernel = clCreateKernel(d.program, "gemm", &error);
+    CONTROL("clCreateKernel", error);
+
+    d.a_buffer = clCreateBuffer(d.context, CL_MEM_READ_ONLY, sizeof(float) * m * n, nullptr, &error);
+    CONTROL("clCreateBuffer A", error);
+    d.b_buffer = clCreateBuffer(d.context, CL_MEM_READ_ONLY, sizeof(float) * n * k, nullptr, &error);
+    CONTROL("clCreateBuffer B", error);
+    d.c_buffer = clCreateBuffer(d.context, CL_MEM_WRITE_ONLY, sizeof(float) * m * k, nullptr, &error);
+    CONTROL("clCreateBuffer C", error);
+    CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(d.queue, d.b_buffer, CL_TRUE, 0, sizeof(float) * n * k, b, 0, nullptr, nullptr));
+
+    CONTROL("clSetKernelArg M", clSetKernelArg(d.kernel, 0, sizeof(unsigned int), &m));
+    CONTROL("clSetKernelArg N", clSetKernelArg(d.kernel, 1, sizeof(unsigned int), &n));
+    CONTROL("clSetKernelArg K", clSetKernelArg(d.kernel, 2, sizeof(unsigned int), &k));
+    CONTROL("clSetKernelArg A", clSetKernelArg(d.kernel, 3, sizeof(cl_mem), &d.a_buffer));
+    CONTROL("clSetKernelArg B", clSetKernelArg(d.kernel, 4, sizeof(cl_mem), &d.b_buffer));
+    CONTROL("clSetKernelArg C", clSetKernelArg(d.kernel, 5, sizeof(cl_mem), &d.c_buffer));
+}
+
+// Guided self-scheduling weighted by the measured rates: a device takes half of its share of the
+// remaining rows, so chunks are large for the faster device at first and shrink to one tile at the end
+static size_t takeGemmTile(GemmDevice& self, std::vector<GemmDevice*>& devices, size_t& next, const size_t m, size_t& rows) {
+    const size_t remaining = m - next;
+    bool measured = true;
+    for (auto d : devices)
+        measured = measured && d->rate > 0.0;
+    size_t chunk = GEMM_TILE;
+    if (measured || self.share > 0.0) {
+        double total = 0.0;
+        for (auto d : devices)
+            total += measured ? d->rate : d->share;
+        const double weight = measured ? self.rate : self.share;
+        chunk = std::max<size_t>(GEMM_TILE, static_cast<size_t>(remaining * weight / total / 2) / GEMM_TILE * GEMM_TILE);
+    }
+    rows = std::min(chunk, remaining);
+    const size_t row = next;
+    next += rows;
+    return row;
+}
+
+static void gemmWorker(GemmDevice& self, std::vector<GemmDevice*>& devices, std::mutex& mutex, size_t& next,
+    const size_t m, const size_t n, const size_t k, const float* a, float* c) {
+    try {
+        while (true) {
+            size_t row = 0, rows = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (next >= m)
+                    break;
+                row = takeGemmTile(self, devices, next, m, rows);
+            }
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            const size_t ndims = 2;
+            size_t offset[ndims] = { 0, row };
+            size_t global[ndims] = { k, rows };
+            size_t local[ndims] = { BLOCK, BLOCK };
+            CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(self.queue, self.a_buffer, CL_FALSE, sizeof(float) * row * n, sizeof(float) * rows * n, &a[row * n], 0, nullptr, nullptr));
+            CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(self.queue, self.kernel, ndims, offset, global, local, 0, nullptr, nullptr));
+            CONTROL("clEnqueueReadBuffer C", clEnqueueReadBuffer(self.queue, self.c_buffer, CL_TRUE, sizeof(float) * row * k, sizeof(float) * rows * k, &c[row * k], 0, nullptr, nullptr));
+            const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            self.rows += rows;
+            self.busy += elapsed.count();
+            self.rate = rows / std::max(elapsed.count(), 1e-9);
         }
+    }
+    catch (...) {
+        self.failure = std::current_exception();
+    }
+}
+
+// Runs the tile scheduler over `all`, the devices keep their rows and busy time for the caller
+static void gemmTiles(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+    std::vector<GemmDevice>& all, timer& time) {
+    std::vector<GemmDevice*> devices;
+    for (auto& d : all)
+        devices.push_back(&d);
+    for (auto d : devices)
+        createGemmDevice(*d, m, n, k, b);
+
+    std::mutex mutex;
+    size_t next = 0;
+    time.first = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> workers;
+    for (auto d : devices)
+        workers.emplace_back(gemmWorker, std::ref(*d), std::ref(devices), std::ref(mutex), std::ref(next), m, n, k, a, c);
+    for (auto& worker : workers)
+        worker.join();
+    time.second = std::chrono::high_resolution_clock::now();
+
+    for (auto d : devices) {
+        clReleaseMemObject(d->a_buffer);
+        clReleaseMemObject(d->b_buffer);
+        clReleaseMemObject(d->c_buffer);
+        clReleaseKernel(d->kernel);
+        clReleaseProgram(d->program);
+        clReleaseCommandQueue(d->queue);
+        clReleaseContext(d->context);
+    }
+    for (auto d : devices)
+        if (d->failure)
+            std::rethrow_exception(d->failure);
+}
+
+void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time) {
+    std::vector<GemmDevice> devices(2);
+    GemmDevice& gpu = devices[0];
+    GemmDevice& cpu = devices[1];
+    gpu.dev_pair = &gpu_dev_pair;
+    cpu.dev_pair = &cpu_dev_pair;
+    // without a calibrated split the first tiles probe the devices
+    double gpu_share = 0.0;
+    if (lookupSplit(cpu_dev_pair, gpu_dev_pair, HETERO_GEMM, double(m) * n * k, gpu_share) && gpu_share > 0.0 && gpu_share < 1.0) {
+        gpu.share = gpu_share;
+        cpu.share = 1.0 - gpu_share;
+    }
+
+    gemmTiles(m, n, k, a, b, c, devices, time);
+    if (gpu.rows > 0 && cpu.rows > 0)
+        updateSplit(cpu_dev_pair, gpu_dev_pair, HETERO_GEMM, double(m) * n * k, gpu.rows, gpu.busy, cpu.rows, cpu.busy);
+    std::cout << "(rows: GPU " << gpu.rows << ", CPU " << cpu.rows << ") ";
+}
 
-        accuracy = std::numeric_limits<float>::min();
-        for (size_t i = 0; i < size; ++i) {
-            if (fabs(norm[i] / x0[i]) > accuracy || x0[i] != 0)
-                accuracy = fabs(norm[i] / x0[i]);
+void gemm_cl(const size_t m, const size_t n, const size_t k, const float* a, const float* b, float* c,
+    std::vector<HeteroDevice>& devices, timer& time) {
+    double total = 0.0;
+    for (auto& d : devices)
+        total += d.weight;
+    std::vector<GemmDevice> tiles(devices.size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        tiles[i].dev_pair = &devices[i].dev_pair;
+        tiles[i].share = devices[i].weight / total;
+    }
+
+    gemmTiles(m, n, k, a, b, c, tiles, time);
+    std::cout << "(rows:";
+    for (auto& d : tiles)
+        std::cout << " " << d.rows;
+    std::cout << ") ";
+}
+
+// One device of the asynchronous Jacobi: it owns the rows [begin, end) split into blocks of group_size rows
+struct AsyncPartition {
+    std::pair<cl_platform_id, cl_device_id>* dev_pair = nullptr;
+    size_t begin = 0, end = 0;
+    cl_context context = nullptr;
+    cl_command_queue queue = nullptr;
+    cl_program program = nullptr;
+    cl_kernel kernel = nullptr;
+    cl_mem a_buffer = nullptr, b_buffer = nullptr, x0_buffer = nullptr, x1_buffer = nullptr;
+    cl_mem norm_buffer = nullptr, blocks_buffer = nullptr;
+    size_t group_size = 0, blocks = 0;
+    std::vector<int> active;        // blocks which aren't frozen
+    std::vector<float> block_norm;
+    std::vector<float> x;           // local copy of the whole vector
+    int version = 0;                // count of slices published in the current round
+    int sweeps = 0;
+    bool done = false;
+    cl_ulong kernel_time = 0;
+    std::exception_ptr failure;
+};
+
+static void createAsyncPartition(AsyncPartition& p, const float* a, const float* b, const float* x0, int size) {
+    cl_int error = CL_SUCCESS;
+    cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)p.dev_pair->first, 0 };
+    p.context = clCreateContext(properties, 1, &p.dev_pair->second, nullptr, nullptr, &error);
+    CONTROL("clCreateContext", error);
+    cl_queue_properties props[3] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+    p.queue = clCreateCommandQueueWithProperties(p.context, p.dev_pair->second, props, &error);
+    CONTROL("clCreateCommandQueue", error);
+
+    p.program = createProgramFromSource(p.context, "kernels/jacobi_kernel.cl");
+    CONTROL("clBuildProgram", clBuildProgram(p.program, 1, &p.dev_pair->second, nullptr, nullptr, nullptr));
+    p.kernel = clCreateKernel(p.program, "jacobi_block", &error);
+    CONTROL("clCreateKernel", error);
+
+    // the block reduction needs a power of two
+    size_t max_group_size = 0;
+    CONTROL("clGetKernelWorkGroupInfo", clGetKernelWorkGroupInfo(p.kernel, p.dev_pair->second, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_group_size, nullptr));
+    p.group_size = 1;
+    while (p.group_size * 2 <= std::min<size_t>(max_group_size, ASYNC_BLOCK))
+        p.group_size *= 2;
+    p.blocks = (p.end - p.begin + p.group_size - 1) / p.group_size;
+    p.block_norm.assign(p.blocks, 0.0f);
+    p.x.assign(x0, x0 + size);
+
+    p.a_buffer = clCreateBuffer(p.context, CL_MEM_READ_ONLY, sizeof(float) * size * size, nullptr, &error);
+    CONTROL("clCreateBuffer A", error);
+    p.b_buffer = clCreateBuffer(p.context, CL_MEM_READ_ONLY, sizeof(float) * size, nullptr, &error);
+    CONTROL("clCreateBuffer B", error);
+    p.x0_buffer = clCreateBuffer(p.context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
+    CONTROL("clCreateBuffer X0", error);
+    p.x1_buffer = clCreateBuffer(p.context, CL_MEM_READ_WRITE, sizeof(float) * size, nullptr, &error);
+    CONTROL("clCreateBuffer X1", error);
+    p.norm_buffer = clCreateBuffer(p.context, CL_MEM_READ_WRITE, sizeof(float) * p.blocks, nullptr, &error);
+    CONTROL("clCreateBuffer NORM", error);
+    p.blocks_buffer = clCreateBuffer(p.context, CL_MEM_READ_ONLY, sizeof(int) * p.blocks, nullptr, &error);
+    CONTROL("clCreateBuffer BLOCKS", error);
+
+    // x1 starts equal to x0, so the rows of frozen blocks stay the same in both vectors
+    CONTROL("clEnqueueWriteBuffer A", clEnqueueWriteBuffer(p.queue, p.a_buffer, CL_TRUE, 0, sizeof(float) * size * size, a, 0, nullptr, nullptr));
+    CONTROL("clEnqueueWriteBuffer B", clEnqueueWriteBuffer(p.queue, p.b_buffer, CL_TRUE, 0, sizeof(float) * size, b, 0, nullptr, nullptr));
+    CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(p.queue, p.x0_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, nullptr, nullptr));
+    CONTROL("clEnqueueWriteBuffer X1", clEnqueueWriteBuffer(p.queue, p.x1_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, nullptr, nullptr));
+
+    const unsigned int first_row = p.begin, last_row = p.end;
+    CONTROL("clSetKernelArg A", clSetKernelArg(p.kernel, 0, sizeof(cl_mem), &p.a_buffer));
+    CONTROL("clSetKernelArg B", clSetKernelArg(p.kernel, 1, sizeof(cl_mem), &p.b_buffer));
+    CONTROL("clSetKernelArg X0", clSetKernelArg(p.kernel, 2, sizeof(cl_mem), &p.x0_buffer));
+    CONTROL("clSetKernelArg X1", clSetKernelArg(p.kernel, 3, sizeof(cl_mem), &p.x1_buffer));
+    CONTROL("clSetKernelArg NORM", clSetKernelArg(p.kernel, 4, sizeof(cl_mem), &p.norm_buffer));
+    CONTROL("clSetKernelArg size", clSetKernelArg(p.kernel, 5, sizeof(unsigned int), &size));
+    CONTROL("clSetKernelArg first_row", clSetKernelArg(p.kernel, 6, sizeof(unsigned int), &first_row));
+    CONTROL("clSetKernelArg last_row", clSetKernelArg(p.kernel, 7, sizeof(unsigned int), &last_row));
+    CONTROL("clSetKernelArg BLOCKS", clSetKernelArg(p.kernel, 8, sizeof(cl_mem), &p.blocks_buffer));
+    CONTROL("clSetKernelArg scratch", clSetKernelArg(p.kernel, 9, sizeof(float) * p.group_size, nullptr));
+
+    p.active.resize(p.blocks);
+    for (size_t i = 0; i < p.blocks; ++i)
+        p.active[i] = i;
+}
+
+// Runs `sweeps` Jacobi sweeps over the active blocks with the neighbour rows of x0 fixed,
+// then reads back the own rows of x and the block norms of the last sweep
+static void asyncSweeps(AsyncPartition& p, const int sweeps) {
+    const size_t rows = p.end - p.begin;
+    const size_t global_size = p.active.size() * p.group_size;
+    CONTROL("clEnqueueWriteBuffer BLOCKS", clEnqueueWriteBuffer(p.queue, p.blocks_buffer, CL_FALSE, 0, sizeof(int) * p.active.size(), p.active.data(), 0, nullptr, nullptr));
+
+    std::vector<cl_event> events(sweeps);
+    for (int s = 0; s < sweeps; ++s) {
+        CONTROL("clEnqueueNDRangeKernel", clEnqueueNDRangeKernel(p.queue, p.kernel, 1, nullptr, &global_size, &p.group_size, 0, nullptr, &events[s]));
+        CONTROL("clEnqueueCopyBuffer", clEnqueueCopyBuffer(p.queue, p.x1_buffer, p.x0_buffer, sizeof(float) * p.begin, sizeof(float) * p.begin, sizeof(float) * rows, 0, nullptr, nullptr));
+    }
+    CONTROL("clEnqueueReadBuffer X", clEnqueueReadBuffer(p.queue, p.x0_buffer, CL_FALSE, sizeof(float) * p.begin, sizeof(float) * rows, &p.x[p.begin], 0, nullptr, nullptr));
+    CONTROL("clEnqueueReadBuffer NORM", clEnqueueReadBuffer(p.queue, p.norm_buffer, CL_TRUE, 0, sizeof(float) * p.blocks, p.block_norm.data(), 0, nullptr, nullptr));
+
+    for (auto evt : events) {
+        cl_ulong evt_start_time = 0, evt_end_time = 0;
+        CONTROL("clGetEventProfilingInfo Start", clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &evt_start_time, nullptr));
+        CONTROL("clGetEventProfilingInfo End", clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &evt_end_time, nullptr));
+        p.kernel_time += evt_end_time - evt_start_time;
+        clReleaseEvent(evt);
+    }
+    p.sweeps += sweeps;
+}
+
+// Worker of one device: iterates its own rows on the latest published neighbour rows, never waits
+// for the other devices unless it is more than `staleness` exchanges ahead of the slowest one
+static void asyncWorker(AsyncPartition& self, std::vector<AsyncPartition*>& partitions, std::vector<float>& shared,
+    std::mutex& mutex, std::condition_variable& published, int size, const int staleness) {
+    try {
+        while (!self.active.empty() && self.sweeps < MAX_ITERS) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                published.wait(lock, [&]() {
+                    int slowest = self.version;
+                    for (auto p : partitions)
+                        if (!p->done)
+                            slowest = std::min(slowest, p->version);
+                    return self.version - slowest <= staleness;
+                });
+                std::memcpy(self.x.data(), shared.data(), sizeof(float) * self.begin);
+                if (self.end < size)
+                    std::memcpy(&self.x[self.end], &shared[self.end], sizeof(float) * (size - self.end));
+            }
+            if (self.begin > 0) {
+                CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(self.queue, self.x0_buffer, CL_FALSE, 0, sizeof(float) * self.begin, self.x.data(), 0, nullptr, nullptr));
+            }
+            if (self.end < size) {
+                CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(self.queue, self.x0_buffer, CL_FALSE, sizeof(float) * self.end, sizeof(float) * (size - self.end), &self.x[self.end], 0, nullptr, nullptr));
+            }
+
+            asyncSweeps(self, ASYNC_SWEEPS);
+
+            std::vector<int> active;
+            for (auto block : self.active)
+                if (self.block_norm[block] >= EPS)
+                    active.push_back(block);
+            self.active.swap(active);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            std::memcpy(&shared[self.begin], &self.x[self.begin], sizeof(float) * (self.end - self.begin));
+            self.version++;
+            published.notify_all();
         }
-        iters++;
+    }
+    catch (...) {
+        self.failure = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    self.done = true;
+    published.notify_all();
+}
 
-        std::swap(x0, x1);
+// Asynchronous Jacobi over the rows given by the bounds of `all`
+static void asyncParts(const float* a, const float* b, const float* x0, float* x1, int size, std::vector<AsyncPartition>& all,
+    timer& time, cl_ulong& kernel_time, const int staleness) {
+    std::vector<AsyncPartition*> partitions;
+    for (auto& p : all)
+        if (p.end > p.begin)
+            partitions.push_back(&p);
+    for (auto p : partitions)
+        createAsyncPartition(*p, a, b, x0, size);
 
-        if (accuracy < EPS || iters >= MAX_ITERS)
-            break;
+    std::vector<float> shared(x0, x0 + size);
+    std::mutex mutex;
+    std::condition_variable published;
+    float accuracy = 0.0f;
+    int rounds = 0;
+
+    time.first = std::chrono::high_resolution_clock::now();
+    while (true) {
+        std::vector<std::thread> workers;
+        for (auto p : partitions)
+            workers.emplace_back(asyncWorker, std::ref(*p), std::ref(partitions), std::ref(shared),
+                std::ref(mutex), std::ref(published), size, staleness);
+        for (auto& worker : workers)
+            worker.join();
+        for (auto p : partitions)
+            if (p->failure)
+                std::rethrow_exception(p->failure);
 
-        if (gpu_m > 0) {
-            CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(gpu_queue, gpu_x0_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, NULL, NULL));
+        // Synchronous verification: one sweep of every row from the same snapshot of x,
+        // blocks which still move are thawed for the next asynchronous round
+        rounds++;
+        accuracy = 0.0f;
+        for (auto p : partitions) {
+            CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(p->queue, p->x0_buffer, CL_FALSE, 0, sizeof(float) * size, shared.data(), 0, nullptr, nullptr));
+            p->active.resize(p->blocks);
+            for (size_t i = 0; i < p->blocks; ++i)
+                p->active[i] = i;
+            asyncSweeps(*p, 1);
         }
-        if (cpu_m > 0) {
-            CONTROL("clEnqueueWriteBuffer X0", clEnqueueWriteBuffer(cpu_queue, cpu_x0_buffer, CL_TRUE, 0, sizeof(float) * size, x0, 0, NULL, NULL));
+        int sweeps = 0;
+        for (auto p : partitions) {
+            std::vector<int> active;
+            for (size_t i = 0; i < p->blocks; ++i) {
+                accuracy = std::max(accuracy, p->block_norm[i]);
+                if (p->block_norm[i] >= EPS)
+                    active.push_back(i);
+            }
+            p->active.swap(active);
+            std::memcpy(&shared[p->begin], &p->x[p->begin], sizeof(float) * (p->end - p->begin));
+            // the staleness bound is per round: progress made before the verification doesn't hold anyone back
+            p->version = 0;
+            p->done = false;
+            sweeps = std::max(sweeps, p->sweeps);
         }
+
+        if (accuracy < EPS || sweeps >= MAX_ITERS)
+            break;
     }
     time.second = std::chrono::high_resolution_clock::now();
 
-    if (gpu_m > 0) {
-        CONTROL("clFinish", clFinish(gpu_queue));
+    std::memcpy(x1, shared.data(), sizeof(float) * size);
+    kernel_time = 0;
+    for (auto p : partitions)
+        kernel_time = std::max(kernel_time, p->kernel_time);
+
+    if (accuracy < EPS) {
+        std::cout << "[ INFO ] Accuracy (" << accuracy << ") is achieved (sweeps:";
+        for (auto p : partitions)
+            std::cout << " " << p->sweeps;
+        std::cout << ", verifications: " << rounds << ")" << std::endl;
     }
-    if (cpu_m > 0) {
-        CONTROL("clFinish", clFinish(cpu_queue));
+    else
+        std::cout << "[ INFO ] Accuracy isn't achieved (" << accuracy << "), count of iterations is exceeded" << std::endl;
+
+    for (auto p : partitions) {
+        clReleaseMemObject(p->a_buffer);
+        clReleaseMemObject(p->b_buffer);
+        clReleaseMemObject(p->x0_buffer);
+        clReleaseMemObject(p->x1_buffer);
+        clReleaseMemObject(p->norm_buffer);
+        clReleaseMemObject(p->blocks_buffer);
+        clReleaseKernel(p->kernel);
+        clReleaseProgram(p->program);
+        clReleaseCommandQueue(p->queue);
+        clReleaseContext(p->context);
     }
+}
 
-    if (accuracy < EPS)
-        std::cout << "[ INFO ] Accuracy (" << accuracy << ") is achieved (iters: " << iters << ")" << std::endl;
-    else if (iters >= MAX_ITERS)
-        std::cout << "[ INFO ] Accuracy isn't achieved (" << accuracy << "), count of iterations is exceeded" << std::endl;
+void jacobi_async_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+    std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair, timer& time,
+    cl_ulong& kernel_time, const int gpu_m, const int staleness) {
+    std::vector<AsyncPartition> partitions(2);
+    partitions[0].dev_pair = &gpu_dev_pair; partitions[0].begin = 0;     partitions[0].end = gpu_m;
+    partitions[1].dev_pair = &cpu_dev_pair; partitions[1].begin = gpu_m; partitions[1].end = size;
+    asyncParts(a, b, x0, x1, size, partitions, time, kernel_time, staleness);
+}
 
-    if (gpu_m > 0) {
-        clReleaseMemObject(gpu_a_buffer);
-        clReleaseMemObject(gpu_b_buffer);
-        clReleaseMemObject(gpu_x0_buffer);
-        clReleaseMemObject(gpu_x1_buffer);
-        clReleaseMemObject(gpu_norm_buffer);
-    }
-    if (cpu_m > 0) {
-        clReleaseMemObject(cpu_a_buffer);
-        clReleaseMemObject(cpu_b_buffer);
-        clReleaseMemObject(cpu_x0_buffer);
-        clReleaseMemObject(cpu_x1_buffer);
-        clReleaseMemObject(cpu_norm_buffer);
-    }
-
-    clReleaseProgram(cpu_program);    clReleaseProgram(gpu_program);
-    clReleaseKernel(cpu_kernel);      clReleaseKernel(gpu_kernel);
-    clReleaseCommandQueue(cpu_queue); clReleaseCommandQueue(gpu_queue);
-    clReleaseContext(cpu_context);    clReleaseContext(gpu_context);
+void jacobi_async_cl(const float* a, const float* b, const float* x0, float* x1, int size,
+    std::vector<HeteroDevice>& devices, timer& time, cl_ulong& kernel_time, const int staleness) {
+    const std::vector<size_t> bounds = splitRows(devices, size, ASYNC_BLOCK);
+    std::vector<AsyncPartition> partitions(devices.size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        partitions[i].dev_pair = &devices[i].dev_pair;
+        partitions[i].begin = bounds[i];
+        partitions[i].end = bounds[i + 1];
+    }
+    asyncParts(a, b, x0, x1, size, partitions, time, kernel_time, staleness);
 }
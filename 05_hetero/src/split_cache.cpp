@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include "..\include\split_cache.h"
+
+struct SplitEntry {
+    double gpu_share = 0.5;
+    int samples = 0;
+};
+
+static std::mutex cache_mutex;
+static std::map<std::string, SplitEntry> cache;
+static bool cache_loaded = false;
+
+// Device names can contain spaces, they are replaced so that a key stays one token of the file
+static std::string deviceName(cl_device_id device) {
+    char name[128] = { 0 };
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name, nullptr);
+    std::string result(name);
+    std::replace(result.begin(), result.end(), ' ', '_');
+    return result;
+}
+
+static std::string splitKey(std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair,
+    HeteroAlgorithm algorithm, const double work) {
+    const int shape_class = static_cast<int>(std::log2(std::max(work, 1.0)));
+    return deviceName(gpu_dev_pair.second) + "|" + deviceName(cpu_dev_pair.second) + "|" +
+        std::to_string(algorithm) + "|" + std::to_string(shape_class);
+}
+
+static void loadCache() {
+    if (cache_loaded)
+        return;
+    cache_loaded = true;
+    std::ifstream file(SPLIT_CACHE_FILE);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        SplitEntry entry;
+        if (fields >> key >> entry.gpu_share >> entry.samples)
+            cache[key] = entry;
+    }
+}
+
+static void saveCache() {
+    std::ofstream file(SPLIT_CACHE_FILE);
+    for (auto& it : cache)
+        file << it.first << " " << it.second.gpu_share << " " << it.second.samples << std::endl;
+}
+
+bool lookupSplit(std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair,
+    HeteroAlgorithm algorithm, const double work, double& gpu_share) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    loadCache();
+    auto it = cache.find(splitKey(cpu_dev_pair, gpu_dev_pair, algorithm, work));
+    if (it == cache.end())
+        return false;
+    gpu_share = it->second.gpu_share;
+    return true;
+}
+
+void updateSplit(std::pair<cl_platform_id, cl_device_id>& cpu_dev_pair, std::pair<cl_platform_id, cl_device_id>& gpu_dev_pair,
+    HeteroAlgorithm algorithm, const double work, const double gpu_rows, const double gpu_seconds,
+    const double cpu_rows, const double cpu_seconds) {
+    if (gpu_rows <= 0 || cpu_rows <= 0 || gpu_seconds <= 0 || cpu_seconds <= 0)
+        return;
+    const double gpu_rate = gpu_rows / gpu_seconds;
+    const double cpu_rate = cpu_rows / cpu_seconds;
+    const double observed = gpu_rate / (gpu_rate + cpu_rate);
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    loadCache();
+    SplitEntry& entry = cache[splitKey(cpu_dev_pair, gpu_dev_pair, algorithm, work)];
+    entry.gpu_share = (entry.gpu_share * entry.samples + observed) / (entry.samples + 1);
+    entry.samples = std::min(entry.samples + 1, SPLIT_HISTORY);
+    saveCache();
+}